@@ -1,169 +1,317 @@
+#include "map.h"
 #include "heap.h"
-#include "queue.h"
 #include <stdlib.h>
 #include <stdio.h>
 
 typedef struct HeapNode HeapNode;
 
-Heap *newHeap(City *root) {
-  Heap *aux = malloc(sizeof(Heap));
-  HeapNode *start = malloc(sizeof(HeapNode));
-  start->city = root;
-  start->distance = 0;
-  start->visited = false;
-  start->year = INT32_MAX;
-  start->left = NULL;
-  start->right = NULL;
-  start->parent = NULL;
-  start->from = NULL;
-  root->heapNode = start;
-  Queue *new = newQueue();
-  pushQueue(new, start);
-  aux->last = new;
-  aux->root = start;
+void emptyScratch(Scratch *scratch) {
+  scratch->nodes[false] = scratch->nodes[true] = NULL;
+  scratch->capacity[false] = scratch->capacity[true] = 0;
+  scratch->potentials = NULL;
+  scratch->guided = 0;
+  scratch->search = 0;
+}
+
+uint32_t scratchSize(uint32_t capacity, uint32_t size) {
+  capacity = capacity ? capacity : 16;
+  while (capacity < size) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+void growNodes(Scratch *scratch, bool backward, uint32_t size) {
+  if (size <= scratch->capacity[backward]) {
+    return;
+  }
+  scratch->capacity[backward] = scratchSize(scratch->capacity[backward], size);
+  free(scratch->nodes[backward]);
+  scratch->nodes[backward] = calloc(scratch->capacity[backward],
+                                    sizeof(HeapNode));
+}
+
+void resetScratch(Scratch *scratch, uint32_t size, bool backward) {
+  if (!++scratch->search) {
+    free(scratch->nodes[false]);
+    free(scratch->nodes[true]);
+    scratch->nodes[false] = scratch->nodes[true] = NULL;
+    scratch->capacity[false] = scratch->capacity[true] = 0;
+    scratch->search = 1;
+  }
+  growNodes(scratch, false, size);
+  if (backward) {
+    growNodes(scratch, true, size);
+  }
+}
+
+void freeScratch(Scratch *scratch) {
+  free(scratch->nodes[false]);
+  free(scratch->nodes[true]);
+  free(scratch->potentials);
+  emptyScratch(scratch);
+}
+
+HeapNode *newNode(Heap *heap, City *city, uint64_t distance, int year) {
+  HeapNode *aux = &heap->scratch->nodes[heap->backward][city->id];
+  if (heap->count == heap->createdCapacity) {
+    heap->createdCapacity *= 2;
+    heap->created = realloc(heap->created,
+                            heap->createdCapacity * sizeof(HeapNode *));
+  }
+  heap->created[heap->count++] = aux;
+  aux->city = city;
+  aux->from = NULL;
+  aux->visited = false;
+  aux->backward = heap->backward;
+  aux->search = heap->scratch->search;
+  aux->distance = distance;
+  aux->year = year;
+  aux->ties = 0;
+  aux->tied = false;
+  if (heap->estimate) {
+    heap->scratch->potentials[city->id] = heap->estimate(heap->goal, city);
+  }
+  aux->position = 0;
   return aux;
 }
 
-void insertHeap(Heap *heap, City *city) {
-  QueueNode *aux = topQueue(heap->last);
-  if (aux->node->left) {
-    aux->node->right = malloc(sizeof(HeapNode));
-    aux->node->right->parent = aux->node;
-    aux->node->right->left = NULL;
-    aux->node->right->right = NULL;
-    aux->node->right->visited = false;
-    aux->node->right->city = city;
-    aux->node->right->distance = UINT64_MAX;
-    aux->node->right->year = 0;
-    aux->node->right->from = NULL;
-    city->heapNode = aux->node->right;
-    pushQueue(heap->last, aux->node->right);
-    popQueue(heap->last);
+HeapNode *cityNode(Heap *heap, City *city) {
+  HeapNode *node = &heap->scratch->nodes[heap->backward][city->id];
+  return node->search == heap->scratch->search ? node : NULL;
+}
+
+HeapNode *touchNode(Heap *heap, City *city) {
+  HeapNode *node = cityNode(heap, city);
+  if (!node) {
+    node = newNode(heap, city, UINT64_MAX, 0);
+  }
+  return node;
+}
+
+void pushNode(Heap *heap, HeapNode *node) {
+  if (heap->size == heap->capacity) {
+    heap->capacity *= 2;
+    heap->nodes = realloc(heap->nodes, heap->capacity * sizeof(HeapNode *));
+  }
+  node->position = heap->size;
+  heap->nodes[heap->size++] = node;
+}
+
+unsigned bucketOf(Heap *heap, uint64_t distance) {
+  if (distance == heap->last) {
+    return 0;
+  }
+  return 64 - __builtin_clzll(distance ^ heap->last);
+}
+
+void pushBucket(Heap *heap, HeapNode *node) {
+  Bucket *bucket = &heap->buckets[bucketOf(heap, node->distance)];
+  if (bucket->size == bucket->capacity) {
+    bucket->capacity = bucket->capacity ? 2 * bucket->capacity : 16;
+    bucket->nodes = realloc(bucket->nodes,
+                            bucket->capacity * sizeof(HeapNode *));
+  }
+  node->bucket = bucket - heap->buckets;
+  node->position = bucket->size;
+  bucket->nodes[bucket->size++] = node;
+}
+
+void removeBucket(Heap *heap, HeapNode *node) {
+  Bucket *bucket = &heap->buckets[node->bucket];
+  HeapNode *last = bucket->nodes[--bucket->size];
+  bucket->nodes[node->position] = last;
+  last->position = node->position;
+}
+
+Heap *newHeap(Scratch *scratch, City *root, HeapEngine engine, bool backward) {
+  Heap *aux = malloc(sizeof(Heap));
+  aux->engine = engine;
+  aux->backward = backward;
+  aux->scratch = scratch;
+  aux->size = 0;
+  aux->last = 0;
+  aux->count = 0;
+  aux->createdCapacity = 16;
+  aux->created = malloc(aux->createdCapacity * sizeof(HeapNode *));
+  aux->estimate = NULL;
+  aux->goal = NULL;
+  for (int i = 0; i < RADIX_BUCKETS; i++) {
+    aux->buckets[i].nodes = NULL;
+    aux->buckets[i].size = aux->buckets[i].capacity = 0;
+  }
+  if (engine == DARY_HEAP) {
+    aux->capacity = 16;
+    aux->nodes = malloc(aux->capacity * sizeof(HeapNode *));
   } else {
-    aux->node->left = malloc(sizeof(HeapNode));
-    aux->node->left->parent = aux->node;
-    aux->node->left->left = NULL;
-    aux->node->left->right = NULL;
-    aux->node->left->visited = false;
-    aux->node->left->city = city;
-    aux->node->left->distance = UINT64_MAX;
-    aux->node->left->year = 0;
-    aux->node->left->from = NULL;
-    city->heapNode = aux->node->left;
-    pushQueue(heap->last, aux->node->left);
-  }
-}
-
-void swapInfo(HeapNode *a, HeapNode *b) {
-  uint64_t auxDistance = a->distance;
-  int auxYear = a->year;
-  Road *auxFrom = a->from;
-  City *auxCity = a->city;
-  a->distance = b->distance;
-  a->year = b->year;
-  a->city = b->city;
-  a->from = b->from;
-  b->distance = auxDistance;
-  b->year = auxYear;
-  b->city = auxCity;
-  b->from = auxFrom;
-  a->city->heapNode = a;
-  b->city->heapNode = b;
-}
-
-inline bool maxi(int x, int y) {
-  return x >= y;
-}
-
-void heapifyMin(HeapNode *root) {
-  if (!root->left && root->right) {
-    if (root->right->distance == root->distance) {
-      if (maxi(root->right->year, root->year)) {
-        swapInfo(root->right, root);
-        heapifyMin(root->right);
-      }
-    } else if (root->right->distance < root->distance) {
-      swapInfo(root->right, root);
-      heapifyMin(root->right);
+    aux->capacity = 0;
+    aux->nodes = NULL;
+  }
+  insertHeap(aux, root, 0, INT32_MAX);
+  return aux;
+}
+
+void guideHeap(Heap *heap, Estimate estimate, void *goal) {
+  Scratch *scratch = heap->scratch;
+  if (scratch->guided < scratch->capacity[false]) {
+    scratch->guided = scratch->capacity[false];
+    free(scratch->potentials);
+    scratch->potentials = malloc(scratch->guided * sizeof(uint64_t));
+  }
+  heap->estimate = estimate;
+  heap->goal = goal;
+  for (size_t i = 0; i < heap->count; i++) {
+    scratch->potentials[heap->created[i]->city->id] =
+        estimate(goal, heap->created[i]->city);
+  }
+}
+
+uint64_t nodeKey(Heap *heap, HeapNode *node) {
+  if (!heap->estimate) {
+    return node->distance;
+  }
+  return node->distance + heap->scratch->potentials[
+      node - heap->scratch->nodes[node->backward]];
+}
+
+bool before(Heap *heap, HeapNode *a, HeapNode *b) {
+  uint64_t keyA = nodeKey(heap, a), keyB = nodeKey(heap, b);
+  if (keyA != keyB) {
+    return keyA < keyB;
+  }
+  if (a->distance != b->distance) {
+    return a->distance < b->distance;
+  }
+  return a->year > b->year;
+}
+
+void placeNode(Heap *heap, HeapNode *node, size_t position) {
+  heap->nodes[position] = node;
+  node->position = position;
+}
+
+void goUp(Heap *heap, HeapNode *node) {
+  size_t position = node->position;
+  while (position) {
+    size_t parent = (position - 1) / HEAP_ARITY;
+    if (!before(heap, node, heap->nodes[parent])) {
+      break;
     }
+    placeNode(heap, heap->nodes[parent], position);
+    position = parent;
   }
-  else if (root->left && !root->right) {
-    if (root->left->distance == root->distance) {
-      if (maxi(root->left->year, root->year)) {
-        swapInfo(root->left, root);
-        heapifyMin(root->left);
-      }
-    } else if (root->left->distance < root->distance) {
-      swapInfo(root->left, root);
-      heapifyMin(root->left);
+  placeNode(heap, node, position);
+}
+
+void heapifyMin(Heap *heap, HeapNode *node) {
+  size_t position = node->position;
+  while (true) {
+    size_t first = position * HEAP_ARITY + 1;
+    if (first >= heap->size) {
+      break;
     }
-  } else if (root->left && root->right) {
-    if (root->left->distance < root->right->distance ||
-        (root->left->distance == root->right->distance &&
-         maxi(root->left->year, root->right->year))) {
-      if (root->left->distance < root->distance ||
-          (root->left->distance == root->distance &&
-           maxi(root->left->year, root->year))) {
-        swapInfo(root->left, root);
-        heapifyMin(root->left);
-      }
+    size_t last = first + HEAP_ARITY;
+    if (last > heap->size) {
+      last = heap->size;
     }
-    else if (root->right->distance < root->left->distance ||
-        (root->right->distance == root->left->distance &&
-         maxi(root->right->year, root->left->year))) {
-      if (root->right->distance < root->distance ||
-          (root->right->distance == root->distance &&
-           maxi(root->right->year, root->year))) {
-        swapInfo(root->right, root);
-        heapifyMin(root->right);
+    size_t best = first;
+    for (size_t i = first + 1; i < last; i++) {
+      if (before(heap, heap->nodes[i], heap->nodes[best])) {
+        best = i;
       }
     }
+    if (!before(heap, heap->nodes[best], node)) {
+      break;
+    }
+    placeNode(heap, heap->nodes[best], position);
+    position = best;
   }
+  placeNode(heap, node, position);
 }
 
-void freeMe(Heap *heap, HeapNode *root) {
-  if (root->parent) {
-    if (root->parent->left == root) {
-      root->parent->left = NULL;
-    } else {
-      root->parent->right = NULL;
-    }
+HeapNode *insertHeap(Heap *heap, City *city, uint64_t dist, int year) {
+  HeapNode *node = newNode(heap, city, dist, year);
+  if (heap->engine == DARY_HEAP) {
+    pushNode(heap, node);
+    goUp(heap, node);
   } else {
-    heap->root = NULL;
+    pushBucket(heap, node);
+    heap->size++;
   }
-  root->visited = true;
+  return node;
 }
 
-HeapNode *minHeap(Heap *heap) {
-  HeapNode *last = popEndQueue(heap->last);
-  swapInfo(heap->root, last);
-  freeMe(heap, last);
-  if (heap->root) {
-    heapifyMin(heap->root);
-  }
-  return last;
-}
-
-void goUp(HeapNode *root) {
-  if (root->parent) {
-    if (root->parent->distance > root->distance) {
-      swapInfo(root->parent, root);
-      goUp(root->parent);
-    } else if (root->parent->distance == root->distance &&
-               maxi(root->year, root->parent->year)) {
-      swapInfo(root->parent, root);
-      goUp(root->parent);
+bool emptyHeap(Heap *heap) {
+  return !heap->size;
+}
+
+HeapNode *radixTop(Heap *heap) {
+  if (!heap->buckets[0].size) {
+    unsigned i = 1;
+    while (!heap->buckets[i].size) {
+      i++;
+    }
+    Bucket *bucket = &heap->buckets[i];
+    uint64_t min = UINT64_MAX;
+    for (size_t j = 0; j < bucket->size; j++) {
+      if (bucket->nodes[j]->distance < min) {
+        min = bucket->nodes[j]->distance;
+      }
+    }
+    heap->last = min;
+    size_t size = bucket->size;
+    bucket->size = 0;
+    for (size_t j = 0; j < size; j++) {
+      pushBucket(heap, bucket->nodes[j]);
     }
   }
+  Bucket *bucket = &heap->buckets[0];
+  return bucket->nodes[bucket->size - 1];
 }
 
-void decreaseValue(HeapNode *root, uint64_t dist, int year) {
-  root->distance = dist;
-  root->year = year;
-  goUp(root);
+HeapNode *topHeap(Heap *heap) {
+  if (heap->engine == RADIX_HEAP) {
+    return radixTop(heap);
+  }
+  return heap->nodes[0];
+}
+
+HeapNode *minHeap(Heap *heap) {
+  if (heap->engine == RADIX_HEAP) {
+    HeapNode *min = radixTop(heap);
+    heap->buckets[0].size--;
+    heap->size--;
+    min->visited = true;
+    return min;
+  }
+  HeapNode *min = heap->nodes[0];
+  HeapNode *last = heap->nodes[--heap->size];
+  if (heap->size) {
+    placeNode(heap, last, 0);
+    heapifyMin(heap, last);
+  }
+  min->visited = true;
+  return min;
+}
+
+void decreaseValue(Heap *heap, HeapNode *node, uint64_t dist, int year) {
+  if (heap->engine == RADIX_HEAP) {
+    removeBucket(heap, node);
+    node->distance = dist;
+    node->year = year;
+    pushBucket(heap, node);
+    return;
+  }
+  node->distance = dist;
+  node->year = year;
+  goUp(heap, node);
 }
 
 void freeHeap(Heap *heap) {
-  freeQueue(heap->last);
+  free(heap->created);
+  for (int i = 0; i < RADIX_BUCKETS; i++) {
+    free(heap->buckets[i].nodes);
+  }
+  free(heap->nodes);
   free(heap);
-}
\ No newline at end of file
+}
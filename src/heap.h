@@ -1,42 +1,99 @@
 #ifndef DROGI_HEAP_H
 #define DROGI_HEAP_H
 
-#include "map.h"
-#include "queue.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HEAP_ARITY 4     /**<Number of children of every node in the heap*/
+#define RADIX_BUCKETS 65 /**<Number of buckets of the radix heap*/
 
 typedef struct City City;
 typedef struct HeapNode HeapNode;
 typedef struct Heap Heap;
-typedef struct Queue Queue;
+typedef struct Bucket Bucket;
+typedef struct Scratch Scratch;
 typedef struct Road Road;
 
+/**
+ * @brief Kinds of priority queue which can drive the search
+ */
+typedef enum HeapEngine {
+  DARY_HEAP,                /**<Comparison based d-ary heap*/
+  RADIX_HEAP                /**<Monotone radix heap over distances*/
+} HeapEngine;
+
+/**
+ * @brief Lower bound of the distance left from a city to the destination
+ */
+typedef uint64_t (*Estimate)(void *goal, City *city);
+
 /**
  * @brief Structure for certain heap node
  */
 struct HeapNode{
   City *city;               /**<The city in the node*/
   Road *from;               /**<Best way found to that node*/
-  bool visited;             /**<Is the node visited before*/
   uint64_t distance;        /**<The best distance to node found so far*/
+  uint32_t search;          /**<Search which set the node*/
   int year;                 /**<The newest year to node found so far*/
-  struct HeapNode *parent;  /**<Parent node in the heap*/
-  struct HeapNode *left;    /**<Left node in the heap*/
-  struct HeapNode *right;   /**<Right node in the heap*/
+  uint32_t position;        /**<Index of the node in its array*/
+  unsigned ties : 2;        /**<Neighbours offering the best way, up to 2*/
+  unsigned bucket : 7;      /**<Bucket of the node in the radix heap*/
+  bool visited : 1;         /**<Is the node visited before*/
+  bool backward : 1;        /**<Is the node kept as backward node of the city*/
+  bool tied : 1;            /**<Is the best way to the settled node ambiguous*/
+};
+/**
+ * @brief Structure for bucket of the radix heap
+ */
+struct Bucket{
+  HeapNode **nodes;         /**<Nodes in the bucket in no particular order*/
+  size_t size;              /**<Number of nodes in the bucket*/
+  size_t capacity;          /**<Allocated length of the array*/
+};
+/**
+ * @brief Structure for nodes of every city reused by following searches
+ */
+struct Scratch{
+  HeapNode *nodes[2];       /**<Forward and backward nodes, by city id*/
+  uint32_t capacity[2];     /**<Number of cities with nodes of each kind*/
+  uint64_t *potentials;     /**<Estimates of guided searches, by city id*/
+  uint32_t guided;          /**<Number of cities with allocated estimates*/
+  uint32_t search;          /**<Current search, older nodes are void*/
 };
 /**
  * @brief Structure for whole heap
  */
 struct Heap{
-  HeapNode *root;           /**<The root of the heap*/
-  Queue *last;              /**<Structure queue used to build heap*/
+  HeapEngine engine;        /**<Kind of the queue*/
+  bool backward;            /**<Are the nodes looked up as backward nodes*/
+  Scratch *scratch;         /**<Storage of the nodes*/
+  size_t size;              /**<Number of nodes in the heap*/
+  HeapNode **nodes;         /**<Array of nodes ordered as a d-ary heap*/
+  size_t capacity;          /**<Allocated length of the array*/
+  Bucket buckets[RADIX_BUCKETS]; /**<Buckets of the radix heap*/
+  uint64_t last;            /**<Last distance taken from the radix heap*/
+  HeapNode **created;       /**<Every node created by the search*/
+  size_t count;             /**<Number of created nodes*/
+  size_t createdCapacity;   /**<Allocated length of the created array*/
+  Estimate estimate;        /**<Lower bound guiding the search or NULL*/
+  void *goal;               /**<Destination passed to the estimate*/
 };
 
-Heap *newHeap(City *root);
-void insertHeap(Heap *heap, struct City *city);
+void emptyScratch(Scratch *scratch);
+void resetScratch(Scratch *scratch, uint32_t size, bool backward);
+void freeScratch(Scratch *scratch);
+Heap *newHeap(Scratch *scratch, City *root, HeapEngine engine, bool backward);
+void guideHeap(Heap *heap, Estimate estimate, void *goal);
+uint64_t nodeKey(Heap *heap, HeapNode *node);
+HeapNode *cityNode(Heap *heap, City *city);
+HeapNode *touchNode(Heap *heap, City *city);
+HeapNode *insertHeap(Heap *heap, City *city, uint64_t dist, int year);
+bool emptyHeap(Heap *heap);
+HeapNode *topHeap(Heap *heap);
 HeapNode *minHeap(Heap *heap);
-void decreaseValue(HeapNode *node, uint64_t dist, int year);
-void freeMe(Heap *heap, HeapNode *root);
-void heapifyMin(HeapNode *root);
+void decreaseValue(Heap *heap, HeapNode *node, uint64_t dist, int year);
 void freeHeap(Heap *heap);
 
-#endif
\ No newline at end of file
+#endif
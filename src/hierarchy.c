@@ -0,0 +1,345 @@
+#include "map.h"
+#include "map_internal.h"
+#include "hierarchy.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PRIORITY_OFFSET (1ULL << 40)
+
+void pushFrontier(Frontier *frontier, uint64_t key, uint32_t node) {
+  if (frontier->size == frontier->capacity) {
+    frontier->capacity = frontier->capacity ? 2 * frontier->capacity : 64;
+    frontier->entries = realloc(frontier->entries,
+                                frontier->capacity * sizeof(Entry));
+  }
+  size_t position = frontier->size++;
+  while (position) {
+    size_t parent = (position - 1) / 2;
+    if (frontier->entries[parent].key <= key) {
+      break;
+    }
+    frontier->entries[position] = frontier->entries[parent];
+    position = parent;
+  }
+  frontier->entries[position].key = key;
+  frontier->entries[position].node = node;
+}
+
+Entry popFrontier(Frontier *frontier) {
+  Entry top = frontier->entries[0];
+  Entry last = frontier->entries[--frontier->size];
+  size_t position = 0;
+  while (true) {
+    size_t child = 2 * position + 1;
+    if (child >= frontier->size) {
+      break;
+    }
+    if (child + 1 < frontier->size &&
+        frontier->entries[child + 1].key < frontier->entries[child].key) {
+      child++;
+    }
+    if (frontier->entries[child].key >= last.key) {
+      break;
+    }
+    frontier->entries[position] = frontier->entries[child];
+    position = child;
+  }
+  if (frontier->size) {
+    frontier->entries[position] = last;
+  }
+  return top;
+}
+
+void addArc(Links *links, uint32_t to, uint64_t length) {
+  for (uint32_t i = 0; i < links->size; i++) {
+    if (links->arcs[i].to == to) {
+      if (length < links->arcs[i].length) {
+        links->arcs[i].length = length;
+      }
+      return;
+    }
+  }
+  if (links->size == links->capacity) {
+    links->capacity = links->capacity ? 2 * links->capacity : 4;
+    links->arcs = realloc(links->arcs, links->capacity * sizeof(Arc));
+  }
+  links->arcs[links->size].to = to;
+  links->arcs[links->size].length = length;
+  links->size++;
+}
+
+void dropArc(Links *links, uint32_t to) {
+  for (uint32_t i = 0; i < links->size; i++) {
+    if (links->arcs[i].to == to) {
+      links->arcs[i] = links->arcs[--links->size];
+      return;
+    }
+  }
+}
+
+void witness(Contraction *c, uint32_t source, uint32_t skip, uint64_t limit,
+             size_t settle) {
+  Entry top;
+  Arc *arc;
+  uint64_t distance;
+  size_t settled = 0;
+  c->frontier.size = 0;
+  c->distance[source] = 0;
+  c->stamp[source] = c->search;
+  pushFrontier(&c->frontier, 0, source);
+  while (c->frontier.size && c->wanted) {
+    top = popFrontier(&c->frontier);
+    if (top.key > c->distance[top.node]) {
+      continue;
+    }
+    if (top.key > limit || settled++ >= settle) {
+      break;
+    }
+    if (c->target[top.node] == c->search) {
+      c->wanted--;
+    }
+    for (uint32_t i = 0; i < c->links[top.node].size; i++) {
+      arc = &c->links[top.node].arcs[i];
+      if (arc->to == skip) {
+        continue;
+      }
+      distance = top.key + arc->length;
+      if (c->stamp[arc->to] != c->search || distance < c->distance[arc->to]) {
+        c->distance[arc->to] = distance;
+        c->stamp[arc->to] = c->search;
+        pushFrontier(&c->frontier, distance, arc->to);
+      }
+    }
+  }
+}
+
+int contract(Contraction *c, uint32_t node, bool simulate) {
+  Links *links = &c->links[node];
+  uint32_t u, w;
+  uint64_t limit, via;
+  int shortcuts = 0;
+  for (uint32_t i = 0; i + 1 < links->size; i++) {
+    u = links->arcs[i].to;
+    limit = 0;
+    c->search++;
+    c->wanted = 0;
+    for (uint32_t j = i + 1; j < links->size; j++) {
+      via = links->arcs[i].length + links->arcs[j].length;
+      if (via > limit) {
+        limit = via;
+      }
+      c->target[links->arcs[j].to] = c->search;
+      c->wanted++;
+    }
+    witness(c, u, node, limit, simulate ? SIMULATED_LIMIT : WITNESS_LIMIT);
+    for (uint32_t j = i + 1; j < links->size; j++) {
+      w = links->arcs[j].to;
+      via = links->arcs[i].length + links->arcs[j].length;
+      if (c->stamp[w] == c->search && c->distance[w] <= via) {
+        continue;
+      }
+      shortcuts++;
+      if (!simulate) {
+        addArc(&c->links[u], w, via);
+        addArc(&c->links[w], u, via);
+      }
+    }
+  }
+  return shortcuts;
+}
+
+uint64_t priority(Contraction *c, uint32_t node) {
+  return PRIORITY_OFFSET + contract(c, node, true) - c->links[node].size +
+         c->deleted[node];
+}
+
+void removeNode(Contraction *c, uint32_t node) {
+  Links *links = &c->links[node];
+  contract(c, node, false);
+  for (uint32_t i = 0; i < links->size; i++) {
+    addArc(&c->upward[node], links->arcs[i].to, links->arcs[i].length);
+    dropArc(&c->links[links->arcs[i].to], node);
+    c->deleted[links->arcs[i].to]++;
+  }
+}
+
+Hierarchy *buildHierarchy(Contraction *c, uint32_t *rank) {
+  Hierarchy *aux = malloc(sizeof(Hierarchy));
+  size_t total = 0;
+  aux->size = c->size;
+  aux->first = calloc(c->size + 1, sizeof(size_t));
+  for (size_t i = 0; i < c->size; i++) {
+    aux->first[rank[i] + 1] = c->upward[i].size;
+    total += c->upward[i].size;
+  }
+  for (size_t i = 0; i < c->size; i++) {
+    aux->first[i + 1] += aux->first[i];
+  }
+  aux->arcs = malloc((total ? total : 1) * sizeof(Arc));
+  for (size_t i = 0; i < c->size; i++) {
+    for (uint32_t j = 0; j < c->upward[i].size; j++) {
+      aux->arcs[aux->first[rank[i]] + j].to = rank[c->upward[i].arcs[j].to];
+      aux->arcs[aux->first[rank[i]] + j].length = c->upward[i].arcs[j].length;
+    }
+  }
+  aux->up = malloc((c->size ? c->size : 1) * sizeof(uint64_t));
+  aux->distance = malloc((c->size ? c->size : 1) * sizeof(uint64_t));
+  aux->upStamp = calloc(c->size ? c->size : 1, sizeof(uint32_t));
+  aux->stamp = calloc(c->size ? c->size : 1, sizeof(uint32_t));
+  aux->query = 0;
+  aux->frontier.entries = NULL;
+  aux->frontier.size = aux->frontier.capacity = 0;
+  aux->stackCapacity = 64;
+  aux->stack = malloc(aux->stackCapacity * sizeof(Frame));
+  return aux;
+}
+
+Hierarchy *newHierarchy(City **cities, size_t count) {
+  Contraction c;
+  Frontier order = {NULL, 0, 0};
+  Entry top;
+  Edges *edges;
+  uint32_t next = 0;
+  uint32_t *rank = malloc((count ? count : 1) * sizeof(uint32_t));
+  c.size = count;
+  c.links = calloc(count ? count : 1, sizeof(Links));
+  c.upward = calloc(count ? count : 1, sizeof(Links));
+  c.deleted = calloc(count ? count : 1, sizeof(uint32_t));
+  c.distance = malloc((count ? count : 1) * sizeof(uint64_t));
+  c.stamp = calloc(count ? count : 1, sizeof(uint32_t));
+  c.target = calloc(count ? count : 1, sizeof(uint32_t));
+  c.search = 0;
+  c.frontier.entries = NULL;
+  c.frontier.size = c.frontier.capacity = 0;
+  for (size_t i = 0; i < count; i++) {
+    cities[i]->rank = i;
+  }
+  for (size_t i = 0; i < count; i++) {
+    for (edges = cities[i]->edges; edges; edges = edges->next) {
+      addArc(&c.links[i], toCity(edges->road, cities[i])->rank,
+             edges->road->length);
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    pushFrontier(&order, priority(&c, i), i);
+  }
+  while (order.size) {
+    top = popFrontier(&order);
+    top.key = priority(&c, top.node);
+    if (order.size && top.key > order.entries[0].key) {
+      pushFrontier(&order, top.key, top.node);
+      continue;
+    }
+    removeNode(&c, top.node);
+    rank[top.node] = next++;
+  }
+  Hierarchy *aux = buildHierarchy(&c, rank);
+  for (size_t i = 0; i < count; i++) {
+    cities[i]->rank = rank[i];
+    free(c.links[i].arcs);
+    free(c.upward[i].arcs);
+  }
+  free(c.links);
+  free(c.upward);
+  free(c.deleted);
+  free(c.distance);
+  free(c.stamp);
+  free(c.target);
+  free(c.frontier.entries);
+  free(order.entries);
+  free(rank);
+  return aux;
+}
+
+void aimHierarchy(Hierarchy *hierarchy, uint32_t target) {
+  Entry top;
+  Arc *arc;
+  uint64_t distance;
+  if (!++hierarchy->query) {
+    memset(hierarchy->upStamp, 0, hierarchy->size * sizeof(uint32_t));
+    memset(hierarchy->stamp, 0, hierarchy->size * sizeof(uint32_t));
+    hierarchy->query = 1;
+  }
+  hierarchy->frontier.size = 0;
+  hierarchy->up[target] = 0;
+  hierarchy->upStamp[target] = hierarchy->query;
+  pushFrontier(&hierarchy->frontier, 0, target);
+  while (hierarchy->frontier.size) {
+    top = popFrontier(&hierarchy->frontier);
+    if (top.key > hierarchy->up[top.node]) {
+      continue;
+    }
+    for (size_t i = hierarchy->first[top.node];
+         i < hierarchy->first[top.node + 1]; i++) {
+      arc = &hierarchy->arcs[i];
+      distance = top.key + arc->length;
+      if (hierarchy->upStamp[arc->to] != hierarchy->query ||
+          distance < hierarchy->up[arc->to]) {
+        hierarchy->up[arc->to] = distance;
+        hierarchy->upStamp[arc->to] = hierarchy->query;
+        pushFrontier(&hierarchy->frontier, distance, arc->to);
+      }
+    }
+  }
+}
+
+uint64_t distanceToTarget(Hierarchy *hierarchy, uint32_t rank) {
+  size_t depth = 0;
+  Frame *frame;
+  uint32_t node;
+  uint64_t best, distance;
+  if (hierarchy->stamp[rank] == hierarchy->query) {
+    return hierarchy->distance[rank];
+  }
+  hierarchy->stack[depth].node = rank;
+  hierarchy->stack[depth++].arc = hierarchy->first[rank];
+  while (depth) {
+    frame = &hierarchy->stack[depth - 1];
+    node = frame->node;
+    while (frame->arc < hierarchy->first[node + 1] &&
+           hierarchy->stamp[hierarchy->arcs[frame->arc].to] ==
+           hierarchy->query) {
+      frame->arc++;
+    }
+    if (frame->arc < hierarchy->first[node + 1]) {
+      if (depth == hierarchy->stackCapacity) {
+        hierarchy->stackCapacity *= 2;
+        hierarchy->stack = realloc(hierarchy->stack,
+                                   hierarchy->stackCapacity * sizeof(Frame));
+      }
+      node = hierarchy->arcs[hierarchy->stack[depth - 1].arc].to;
+      hierarchy->stack[depth].node = node;
+      hierarchy->stack[depth++].arc = hierarchy->first[node];
+      continue;
+    }
+    best = hierarchy->upStamp[node] == hierarchy->query ?
+           hierarchy->up[node] : UINT64_MAX;
+    for (size_t i = hierarchy->first[node]; i < hierarchy->first[node + 1];
+         i++) {
+      distance = hierarchy->distance[hierarchy->arcs[i].to];
+      if (distance != UINT64_MAX &&
+          distance + hierarchy->arcs[i].length < best) {
+        best = distance + hierarchy->arcs[i].length;
+      }
+    }
+    hierarchy->distance[node] = best;
+    hierarchy->stamp[node] = hierarchy->query;
+    depth--;
+  }
+  return hierarchy->distance[rank];
+}
+
+void freeHierarchy(Hierarchy *hierarchy) {
+  if (!hierarchy) {
+    return;
+  }
+  free(hierarchy->first);
+  free(hierarchy->arcs);
+  free(hierarchy->up);
+  free(hierarchy->distance);
+  free(hierarchy->upStamp);
+  free(hierarchy->stamp);
+  free(hierarchy->frontier.entries);
+  free(hierarchy->stack);
+  free(hierarchy);
+}
@@ -0,0 +1,96 @@
+#ifndef DROGI_HIERARCHY_H
+#define DROGI_HIERARCHY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NO_RANK UINT32_MAX       /**<Rank of a city outside the hierarchy*/
+#define WITNESS_LIMIT 100        /**<Cities settled by one witness search*/
+#define SIMULATED_LIMIT 8        /**<Limit when only counting shortcuts*/
+#define UNREACHABLE (UINT64_MAX / 4) /**<Estimate for cities cut off*/
+
+typedef struct City City;
+typedef struct Arc Arc;
+typedef struct Links Links;
+typedef struct Entry Entry;
+typedef struct Frontier Frontier;
+typedef struct Frame Frame;
+typedef struct Contraction Contraction;
+typedef struct Hierarchy Hierarchy;
+
+/**
+ * @brief Structure for road or shortcut leading to a city
+ */
+struct Arc{
+  uint32_t to;              /**<Index of the city at the end*/
+  uint64_t length;          /**<Length of the road or shortcut*/
+};
+/**
+ * @brief Structure for list of arcs of a city during contraction
+ */
+struct Links{
+  Arc *arcs;                /**<Array of arcs*/
+  uint32_t size;            /**<Number of arcs*/
+  uint32_t capacity;        /**<Allocated length of the array*/
+};
+/**
+ * @brief Structure for element of the frontier
+ */
+struct Entry{
+  uint64_t key;             /**<Priority of the element*/
+  uint32_t node;            /**<Index of the city*/
+};
+/**
+ * @brief Structure for binary heap of indices without decrease key
+ */
+struct Frontier{
+  Entry *entries;           /**<Array ordered as a binary heap*/
+  size_t size;              /**<Number of elements*/
+  size_t capacity;          /**<Allocated length of the array*/
+};
+/**
+ * @brief Structure for step of the walk computing distances to the target
+ */
+struct Frame{
+  uint32_t node;            /**<Rank of the city*/
+  size_t arc;               /**<Next upward arc to look at*/
+};
+/**
+ * @brief Structure for state of the contraction
+ */
+struct Contraction{
+  size_t size;              /**<Number of cities*/
+  Links *links;             /**<Arcs to cities not contracted yet*/
+  Links *upward;            /**<Arcs to cities contracted later*/
+  uint32_t *deleted;        /**<Number of contracted neighbours*/
+  uint64_t *distance;       /**<Distances found by the witness search*/
+  uint32_t *stamp;          /**<Witness search which set the distance*/
+  uint32_t *target;         /**<Witness search which looks for the city*/
+  uint32_t search;          /**<Number of the current witness search*/
+  uint32_t wanted;          /**<Targets not settled yet*/
+  Frontier frontier;        /**<Frontier of the witness search*/
+};
+/**
+ * @brief Structure for contraction hierarchy over cities of a map
+ */
+struct Hierarchy{
+  size_t size;              /**<Number of cities in the hierarchy*/
+  size_t *first;            /**<Beginning of upward arcs of every rank*/
+  Arc *arcs;                /**<Upward arcs, the ends are ranks*/
+  uint64_t *up;             /**<Upward distances from the target*/
+  uint64_t *distance;       /**<Known distances to the target*/
+  uint32_t *upStamp;        /**<Query which set the upward distance*/
+  uint32_t *stamp;          /**<Query which set the distance*/
+  uint32_t query;           /**<Number of the current query*/
+  Frontier frontier;        /**<Frontier of the upward search*/
+  Frame *stack;             /**<Stack of the walk computing distances*/
+  size_t stackCapacity;     /**<Allocated length of the stack*/
+};
+
+Hierarchy *newHierarchy(City **cities, size_t count);
+void aimHierarchy(Hierarchy *hierarchy, uint32_t target);
+uint64_t distanceToTarget(Hierarchy *hierarchy, uint32_t rank);
+void freeHierarchy(Hierarchy *hierarchy);
+
+#endif
@@ -0,0 +1,365 @@
+#include "map.h"
+#include "map_internal.h"
+#include "load.h"
+#include "scan.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+void emptySeen(Seen *seen, size_t capacity) {
+  seen->keys = malloc(capacity * sizeof(uint64_t));
+  seen->items = malloc(capacity * sizeof(size_t));
+  for (size_t i = 0; i < capacity; i++) {
+    seen->items[i] = NO_RECORD;
+  }
+  seen->capacity = capacity;
+  seen->count = 0;
+}
+
+void freeSeen(Seen *seen) {
+  free(seen->keys);
+  free(seen->items);
+}
+
+size_t seenSlot(Seen *seen, uint64_t key) {
+  return mixHash(key, HASH_KEY) & (seen->capacity - 1);
+}
+
+void growSeen(Seen *seen) {
+  Seen old = *seen;
+  size_t j;
+  emptySeen(seen, 2 * old.capacity);
+  for (size_t i = 0; i < old.capacity; i++) {
+    if (old.items[i] == NO_RECORD) {
+      continue;
+    }
+    j = seenSlot(seen, old.keys[i]);
+    while (seen->items[j] != NO_RECORD) {
+      j = (j + 1) & (seen->capacity - 1);
+    }
+    seen->keys[j] = old.keys[i];
+    seen->items[j] = old.items[i];
+  }
+  seen->count = old.count;
+  freeSeen(&old);
+}
+
+bool sameName(Loader *loader, size_t item1, size_t item2) {
+  Record *first = &loader->records[item1 / 2];
+  Record *second = &loader->records[item2 / 2];
+  size_t length = first->lengths[item1 % 2];
+  return length == second->lengths[item2 % 2] &&
+         !memcmp(first->names[item1 % 2], second->names[item2 % 2], length);
+}
+
+size_t seeKey(Loader *loader, Seen *seen, uint64_t key, size_t item,
+              bool names) {
+  if (4 * (seen->count + 1) > 3 * seen->capacity) {
+    growSeen(seen);
+  }
+  size_t i = seenSlot(seen, key);
+  while (seen->items[i] != NO_RECORD) {
+    if (seen->keys[i] == key &&
+        (!names || sameName(loader, seen->items[i], item))) {
+      return seen->items[i];
+    }
+    i = (i + 1) & (seen->capacity - 1);
+  }
+  seen->keys[i] = key;
+  seen->items[i] = item;
+  seen->count++;
+  return item;
+}
+
+bool ownKey(Loader *loader, uint64_t key, unsigned index) {
+  return (mixHash(key, HASH_KEY) >> 32) % loader->threads == index;
+}
+
+void parseRecord(Loader *loader, Record *record, const char *line,
+                 size_t length) {
+  Field fields[4];
+  size_t i = 0, n;
+  bool control;
+  record->blank = !length;
+  record->valid = record->accepted = false;
+  record->cities[0] = record->cities[1] = NULL;
+  record->same[0] = record->same[1] = NO_RECORD;
+  for (int k = 0; k < 4; k++) {
+    if (i > length) {
+      return;
+    }
+    n = scanField(line + i, length - i, &control);
+    fields[k].text = line + i;
+    fields[k].length = n;
+    fields[k].end = i + n < length ? line[i + n] : '\n';
+    fields[k].name = n && !control;
+    i += n + 1;
+  }
+  if (fields[0].end != ';' || fields[1].end != ';' || fields[2].end != ';' ||
+      fields[3].end != '\n') {
+    return;
+  }
+  if (!fields[0].name || !fields[1].name ||
+      !parseUInt(&fields[2], &record->length) || !record->length ||
+      !parseInt(&fields[3], &record->year) ||
+      (fields[0].length == fields[1].length &&
+       !memcmp(fields[0].text, fields[1].text, fields[0].length))) {
+    return;
+  }
+  for (int k = 0; k < 2; k++) {
+    record->names[k] = fields[k].text;
+    record->lengths[k] = fields[k].length;
+    record->hashes[k] = hashSpan(loader->map, fields[k].text,
+                                 fields[k].length);
+  }
+  record->valid = true;
+}
+
+void countLines(Loader *loader, unsigned index) {
+  size_t i = loader->starts[index], end = loader->starts[index + 1], count = 0;
+  const char *newline;
+  while (i < end) {
+    newline = memchr(loader->text + i, '\n', end - i);
+    i = newline ? (size_t)(newline - loader->text) + 1 : end;
+    count++;
+  }
+  loader->firsts[index + 1] = count;
+}
+
+void parseLines(Loader *loader, unsigned index) {
+  size_t i = loader->starts[index], end = loader->starts[index + 1], next;
+  Record *record = &loader->records[loader->firsts[index]];
+  const char *newline;
+  while (i < end) {
+    newline = memchr(loader->text + i, '\n', end - i);
+    next = newline ? (size_t)(newline - loader->text) : end;
+    parseRecord(loader, record++, loader->text + i, next - i);
+    i = next + 1;
+  }
+}
+
+void findNames(Loader *loader, unsigned index) {
+  Seen seen;
+  Record *record;
+  size_t item, first;
+  emptySeen(&seen, 64);
+  for (size_t i = 0; i < loader->count; i++) {
+    record = &loader->records[i];
+    if (!record->valid) {
+      continue;
+    }
+    for (int k = 0; k < 2; k++) {
+      if (!ownKey(loader, record->hashes[k], index)) {
+        continue;
+      }
+      item = 2 * i + k;
+      first = seeKey(loader, &seen, record->hashes[k], item, true);
+      if (first != item) {
+        record->same[k] = first;
+      } else {
+        record->cities[k] = findSpan(loader->map, record->names[k],
+                                     record->lengths[k], record->hashes[k]);
+      }
+    }
+  }
+  freeSeen(&seen);
+}
+
+void findRoads(Loader *loader, unsigned index) {
+  Seen seen;
+  Record *record;
+  uint64_t key;
+  emptySeen(&seen, 64);
+  for (size_t i = 0; i < loader->count; i++) {
+    record = &loader->records[i];
+    if (!record->valid) {
+      continue;
+    }
+    key = roadKey(record->cities[0], record->cities[1]);
+    if (ownKey(loader, key, index) &&
+        seeKey(loader, &seen, key, i, false) == i &&
+        !isConnected(loader->map, record->cities[0], record->cities[1])) {
+      record->accepted = true;
+    }
+  }
+  freeSeen(&seen);
+}
+
+void makeRoads(Loader *loader, unsigned index) {
+  Record *record;
+  for (size_t i = loader->firsts[index]; i < loader->firsts[index + 1]; i++) {
+    record = &loader->records[i];
+    if (record->accepted) {
+      record->road = makeRoad(record->cities[0], record->cities[1],
+                              record->length, record->year, record->edges);
+    }
+  }
+}
+
+void *loadThread(void *data) {
+  Loading *loading = data;
+  loading->phase(loading->loader, loading->index);
+  return NULL;
+}
+
+void runPhase(Loader *loader, void (*phase)(Loader *, unsigned)) {
+  pthread_t threads[MAX_WORKERS];
+  Loading loadings[MAX_WORKERS];
+  bool started[MAX_WORKERS];
+  for (unsigned i = 1; i < loader->threads; i++) {
+    loadings[i].loader = loader;
+    loadings[i].index = i;
+    loadings[i].phase = phase;
+    started[i] = !pthread_create(&threads[i], NULL, loadThread, &loadings[i]);
+  }
+  phase(loader, 0);
+  for (unsigned i = 1; i < loader->threads; i++) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    } else {
+      phase(loader, i);
+    }
+  }
+}
+
+void splitList(Loader *loader) {
+  size_t start;
+  const char *newline;
+  loader->starts[0] = 0;
+  for (unsigned i = 1; i < loader->threads; i++) {
+    start = loader->size / loader->threads * i;
+    if (start < loader->starts[i - 1]) {
+      start = loader->starts[i - 1];
+    }
+    newline = start ? memchr(loader->text + start - 1, '\n',
+                             loader->size - start + 1) : NULL;
+    loader->starts[i] = newline ? (size_t)(newline - loader->text) + 1
+                                : loader->size;
+  }
+  loader->starts[loader->threads] = loader->size;
+}
+
+void insertCities(Loader *loader) {
+  Map *map = loader->map;
+  Record *record;
+  size_t fresh = 0, same;
+  for (size_t i = 0; i < loader->count; i++) {
+    record = &loader->records[i];
+    for (int k = 0; k < 2; k++) {
+      fresh += record->valid && record->same[k] == NO_RECORD &&
+               !record->cities[k];
+    }
+  }
+  while (4 * (map->cityCount + fresh) > 3 * map->slotCount) {
+    growSlots(map);
+  }
+  for (size_t i = 0; i < loader->count; i++) {
+    record = &loader->records[i];
+    if (!record->valid) {
+      continue;
+    }
+    for (int k = 0; k < 2; k++) {
+      same = record->same[k];
+      if (same != NO_RECORD) {
+        record->cities[k] = loader->records[same / 2].cities[same % 2];
+      } else if (!record->cities[k]) {
+        record->cities[k] = insertSpan(map, record->names[k],
+                                       record->lengths[k], record->hashes[k]);
+      }
+    }
+  }
+}
+
+void buildRoads(Loader *loader) {
+  Map *map = loader->map;
+  Record *record;
+  size_t added = 0;
+  for (size_t i = 0; i < loader->count; i++) {
+    added += loader->records[i].accepted;
+  }
+  while (4 * (map->roadCount + added) > 3 * map->roadSlotCount) {
+    growRoadSlots(map);
+  }
+  for (size_t i = 0; i < loader->count; i++) {
+    record = &loader->records[i];
+    if (record->accepted) {
+      linkRoad(map, record->road, record->edges);
+    }
+  }
+}
+
+void addRecords(Loader *loader) {
+  Map *map = loader->map;
+  Record *record;
+  for (size_t i = 0; i < loader->count; i++) {
+    record = &loader->records[i];
+    if (!record->valid) {
+      continue;
+    }
+    for (int k = 0; k < 2; k++) {
+      record->cities[k] = findSpan(map, record->names[k], record->lengths[k],
+                                   record->hashes[k]);
+      if (!record->cities[k]) {
+        record->cities[k] = insertSpan(map, record->names[k],
+                                       record->lengths[k], record->hashes[k]);
+      }
+    }
+    if (!isConnected(map, record->cities[0], record->cities[1])) {
+      connectCities(map, record->cities[0], record->cities[1],
+                    record->length, record->year);
+      record->accepted = true;
+    }
+  }
+}
+
+size_t loadRoads(Map *map, const char *list, size_t size, size_t **rejected) {
+  Loader loader;
+  size_t count = 0;
+  loader.map = map;
+  loader.text = list;
+  loader.size = size;
+  loader.threads = size / LOAD_PART + 1;
+  if (loader.threads > map->workerCount) {
+    loader.threads = map->workerCount;
+  }
+  loader.starts = malloc((loader.threads + 1) * sizeof(size_t));
+  loader.firsts = malloc((loader.threads + 1) * sizeof(size_t));
+  splitList(&loader);
+  runPhase(&loader, countLines);
+  loader.firsts[0] = 0;
+  for (unsigned i = 0; i < loader.threads; i++) {
+    loader.firsts[i + 1] += loader.firsts[i];
+  }
+  loader.count = loader.firsts[loader.threads];
+  loader.records = malloc(loader.count * sizeof(Record));
+  runPhase(&loader, parseLines);
+  if (loader.threads == 1) {
+    addRecords(&loader);
+  } else {
+    runPhase(&loader, findNames);
+    insertCities(&loader);
+    runPhase(&loader, findRoads);
+    runPhase(&loader, makeRoads);
+    buildRoads(&loader);
+  }
+  if (rejected) {
+    *rejected = NULL;
+  }
+  for (size_t i = 0; i < loader.count; i++) {
+    if (loader.records[i].blank || loader.records[i].accepted) {
+      continue;
+    }
+    if (rejected) {
+      if (!(count & (count - 1))) {
+        *rejected = realloc(*rejected, (count ? 2 * count : 1) *
+                                       sizeof(size_t));
+      }
+      (*rejected)[count] = i + 1;
+    }
+    count++;
+  }
+  free(loader.records);
+  free(loader.starts);
+  free(loader.firsts);
+  return count;
+}
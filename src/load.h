@@ -0,0 +1,68 @@
+#ifndef DROGI_LOAD_H
+#define DROGI_LOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NO_RECORD SIZE_MAX       /**<Item of an empty slot of a set*/
+#define LOAD_PART (1 << 16)      /**<Smallest part of a list for a thread*/
+
+typedef struct City City;
+typedef struct Road Road;
+typedef struct Edges Edges;
+typedef struct Map Map;
+typedef struct Record Record;
+typedef struct Seen Seen;
+typedef struct Loader Loader;
+typedef struct Loading Loading;
+
+/**
+ * @brief Structure for line of a road list
+ */
+struct Record{
+  const char *names[2];     /**<Names of the cities in the list*/
+  size_t lengths[2];        /**<Lengths of the names*/
+  uint64_t hashes[2];       /**<Hashes of the names*/
+  City *cities[2];          /**<Cities of the names once they are known*/
+  Road *road;               /**<Road of the line made before linking*/
+  Edges *edges[2];          /**<Edges of the road made before linking*/
+  size_t same[2];           /**<First side of a record with the same name*/
+  unsigned length;          /**<Length of the road*/
+  int year;                 /**<Year of building of the road*/
+  bool blank;               /**<Is the line empty*/
+  bool valid;               /**<Would addRoad reach the cities of the line*/
+  bool accepted;            /**<Is the road of the line added*/
+};
+/**
+ * @brief Structure for set of keys with linear probing
+ */
+struct Seen{
+  uint64_t *keys;           /**<Keys of the slots*/
+  size_t *items;            /**<First item with the key or NO_RECORD*/
+  size_t capacity;          /**<Number of slots, a power of two*/
+  size_t count;             /**<Number of keys in the set*/
+};
+/**
+ * @brief Structure for bulk load shared by its threads
+ */
+struct Loader{
+  Map *map;                 /**<Map receiving the roads*/
+  const char *text;         /**<The list, read but never written*/
+  size_t size;              /**<Length of the list*/
+  Record *records;          /**<Lines of the list in order*/
+  size_t count;             /**<Number of lines*/
+  size_t *starts;           /**<Beginning of the part of every thread*/
+  size_t *firsts;           /**<First line of the part of every thread*/
+  unsigned threads;         /**<Number of threads of the load*/
+};
+/**
+ * @brief Structure for one thread of the bulk load
+ */
+struct Loading{
+  Loader *loader;           /**<The load*/
+  unsigned index;           /**<Index of the thread*/
+  void (*phase)(Loader *loader, unsigned index); /**<Work of the thread*/
+};
+
+#endif
@@ -1,16 +1,123 @@
 #include "map.h"
+#include "map_internal.h"
 #include "heap.h"
+#include "scan.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
 
-void freeRoutes(Routes *routes) {
-  Routes *help;
-  while (routes) {
-    help = routes;
-    routes = routes->next;
-    free(help);
+void emptyRoutes(RouteSet *set) {
+  set->size = 0;
+  set->bits = NULL;
+  set->spots = NULL;
+}
+
+void freeRoutes(RouteSet *set) {
+  free(set->bits);
+  free(set->spots);
+  emptyRoutes(set);
+}
+
+bool hasRoute(RouteSet *set, unsigned id) {
+  if (set->bits) {
+    return set->bits[id / 64] >> (id % 64) & 1;
+  }
+  for (uint16_t i = 0; i < set->size; i++) {
+    if (set->ids[i] == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t routeSpot(RouteSet *set, unsigned id) {
+  if (set->bits) {
+    return set->spots[id];
+  }
+  uint16_t i = 0;
+  while (set->ids[i] != id) {
+    i++;
   }
+  return set->at[i];
+}
+
+void addRoute(RouteSet *set, unsigned id, uint32_t spot) {
+  if (hasRoute(set, id)) {
+    if (set->bits) {
+      set->spots[id] = spot;
+    } else {
+      uint16_t i = 0;
+      while (set->ids[i] != id) {
+        i++;
+      }
+      set->at[i] = spot;
+    }
+    return;
+  }
+  if (!set->bits && set->size == INLINE_ROUTES) {
+    set->bits = calloc(ROUTE_WORDS, sizeof(uint64_t));
+    set->spots = malloc(R * sizeof(uint32_t));
+    for (uint16_t i = 0; i < set->size; i++) {
+      set->bits[set->ids[i] / 64] |= 1ULL << (set->ids[i] % 64);
+      set->spots[set->ids[i]] = set->at[i];
+    }
+  }
+  if (set->bits) {
+    set->bits[id / 64] |= 1ULL << (id % 64);
+    set->spots[id] = spot;
+  } else {
+    uint16_t i = set->size;
+    for (; i && set->ids[i - 1] > id; i--) {
+      set->ids[i] = set->ids[i - 1];
+      set->at[i] = set->at[i - 1];
+    }
+    set->ids[i] = id;
+    set->at[i] = spot;
+  }
+  set->size++;
+}
+
+void dropRoute(RouteSet *set, unsigned id) {
+  if (!hasRoute(set, id)) {
+    return;
+  }
+  if (set->bits) {
+    set->bits[id / 64] &= ~(1ULL << (id % 64));
+  } else {
+    uint16_t i = 0;
+    while (set->ids[i] != id) {
+      i++;
+    }
+    for (; i + 1 < set->size; i++) {
+      set->ids[i] = set->ids[i + 1];
+      set->at[i] = set->at[i + 1];
+    }
+  }
+  set->size--;
+}
+
+unsigned nextRoute(RouteSet *set, unsigned after) {
+  if (!set->bits) {
+    for (uint16_t i = 0; i < set->size; i++) {
+      if (after == R || set->ids[i] > after) {
+        return set->ids[i];
+      }
+    }
+    return R;
+  }
+  unsigned id = after == R ? 0 : after + 1;
+  uint64_t word;
+  while (id < ROUTE_WORDS * 64) {
+    word = set->bits[id / 64] >> (id % 64);
+    if (word) {
+      return id + __builtin_ctzll(word);
+    }
+    id = (id / 64 + 1) * 64;
+  }
+  return R;
 }
 
 void freeEdges(Edges *this) {
@@ -23,21 +130,104 @@ void freeEdges(Edges *this) {
 }
 
 void freeRoute(Route *route) {
-  freeEdges(route->edges);
+  free(route->steps);
   free(route);
 }
 
+Route *startRoute(City *start) {
+  Route *route = malloc(sizeof(Route));
+  route->start = route->end = start;
+  route->totalCost = 0;
+  route->year = INT32_MAX;
+  route->steps = NULL;
+  route->head = 0;
+  route->first = route->size = route->capacity = 0;
+  return route;
+}
+
+Step *routeStep(Route *route, size_t i) {
+  return &route->steps[route->first + i];
+}
+
+City *stepEnd(Step *step) {
+  return step->forward ? step->road->to : step->road->from;
+}
+
+void reserveSteps(Route *route, size_t front, size_t back) {
+  if (route->first >= front &&
+      route->capacity - route->first - route->size >= back) {
+    return;
+  }
+  size_t capacity = 2 * (route->size + front + back) + 8;
+  size_t first = front + (capacity - route->size - front - back) / 2;
+  Step *steps = malloc(capacity * sizeof(Step));
+  if (route->size) {
+    memcpy(steps + first, routeStep(route, 0), route->size * sizeof(Step));
+  }
+  free(route->steps);
+  route->steps = steps;
+  route->first = first;
+  route->capacity = capacity;
+}
+
+void pushFront(Route *route, Road *road, bool forward) {
+  reserveSteps(route, 1, 0);
+  route->head++;
+  route->first--;
+  route->size++;
+  routeStep(route, 0)->road = road;
+  routeStep(route, 0)->forward = forward;
+}
+
+void pushBack(Route *route, Road *road, bool forward) {
+  reserveSteps(route, 0, 1);
+  route->size++;
+  routeStep(route, route->size - 1)->road = road;
+  routeStep(route, route->size - 1)->forward = forward;
+}
+
+City *cityAt(Map *map, uint32_t id) {
+  return &map->blocks[id / CITY_BLOCK][id % CITY_BLOCK];
+}
+
+void stopWorkers(Map *map) {
+  pthread_mutex_lock(&map->poolLock);
+  map->closing = true;
+  pthread_cond_broadcast(&map->poolWake);
+  pthread_mutex_unlock(&map->poolLock);
+  for (unsigned i = 0; i < map->startedWorkers; i++) {
+    pthread_join(map->workers[i].thread, NULL);
+  }
+  pthread_mutex_destroy(&map->poolLock);
+  pthread_cond_destroy(&map->poolWake);
+  pthread_cond_destroy(&map->poolDone);
+}
+
 void freeMap(Map *map) {
-  City *aux, *help;
-  for (int i = 0; i < N; i++) {
-    aux = map->cities[i];
-    while (aux) {
-      help = aux;
-      freeEdges(aux->edges);
-      free(aux->name);
-      aux = aux->next;
-      free(help);
-    }
+  City *aux;
+  NameChunk *chunk;
+  stopWorkers(map);
+  for (uint32_t i = 0; i < map->cityCount; i++) {
+    aux = cityAt(map, i);
+    freeEdges(aux->edges);
+    free(aux->landmarks);
+  }
+  for (uint32_t i = 0; i < map->cityCount; i += CITY_BLOCK) {
+    free(map->blocks[i / CITY_BLOCK]);
+  }
+  free(map->blocks);
+  while (map->names) {
+    chunk = map->names;
+    map->names = chunk->next;
+    free(chunk);
+  }
+  free(map->slots);
+  free(map->roadSlots);
+  free(map->mask.stamps);
+  freeScratch(&map->scratch);
+  for (int i = 0; i < MAX_WORKERS; i++) {
+    free(map->workers[i].mask.stamps);
+    freeScratch(&map->workers[i].scratch);
   }
   Route *route;
   for (int i = 0; i < R; i++) {
@@ -49,10 +239,11 @@ void freeMap(Map *map) {
   Road *roads = map->roads, *helpRoads;
   while (roads) {
     helpRoads = roads;
-    freeRoutes(roads->routes);
+    freeRoutes(&roads->routes);
     roads = roads->next;
     free(helpRoads);
   }
+  freeHierarchy(map->hierarchy);
   free(map);
 }
 
@@ -60,100 +251,321 @@ void deleteMap(Map *map) {
   freeMap(map);
 }
 
+uint64_t randomSeed(Map *map) {
+  uint64_t seed = (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)map;
+  FILE *source = fopen("/dev/urandom", "rb");
+  if (source) {
+    if (fread(&seed, sizeof(seed), 1, source) != 1) {
+      seed ^= (uint64_t)clock();
+    }
+    fclose(source);
+  }
+  return seed;
+}
+
+void emptyMask(Mask *mask) {
+  mask->stamps = NULL;
+  mask->capacity = 0;
+  mask->epoch = 1;
+}
+
 Map *newMap(void) {
   Map *aux = malloc(sizeof(Map));
   if (!aux) {
     return aux;
   } else {
-    for (int i = 0; i < N; i++) {
-      aux->cities[i] = NULL;
+    aux->slotCount = MIN_SLOTS;
+    aux->cityCount = 0;
+    aux->seed = randomSeed(aux);
+    aux->slots = malloc(aux->slotCount * sizeof(Slot));
+    memset(aux->slots, 0xff, aux->slotCount * sizeof(Slot));
+    aux->blocks = NULL;
+    aux->names = NULL;
+    aux->roadSlotCount = MIN_SLOTS;
+    aux->roadCount = 0;
+    aux->roadSlots = calloc(aux->roadSlotCount, sizeof(RoadSlot));
+    emptyMask(&aux->mask);
+    emptyScratch(&aux->scratch);
+    for (int i = 0; i < MAX_WORKERS; i++) {
+      emptyMask(&aux->workers[i].mask);
+      emptyScratch(&aux->workers[i].scratch);
     }
+    aux->startedWorkers = 0;
+    pthread_mutex_init(&aux->poolLock, NULL);
+    pthread_cond_init(&aux->poolWake, NULL);
+    pthread_cond_init(&aux->poolDone, NULL);
+    aux->repair = NULL;
+    aux->repairRound = 0;
+    aux->helpers = aux->busy = 0;
+    aux->closing = false;
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    setRepairWorkers(aux, processors > 0 ? processors : 1);
     for (int i = 0; i < R; i++) {
       aux->routes[i] = NULL;
     }
     aux->roads = NULL;
+    aux->engine = RADIX_HEAP;
+    aux->landmarkCount = 0;
+    aux->landmarksStale = false;
+    aux->hierarchy = NULL;
+    aux->hierarchyStale = false;
     return aux;
   }
 }
 
+void setHeapEngine(Map *map, HeapEngine engine) {
+  map->engine = engine;
+}
+
+void setRepairWorkers(Map *map, unsigned count) {
+  if (count < 1) {
+    count = 1;
+  } else if (count > MAX_WORKERS) {
+    count = MAX_WORKERS;
+  }
+  map->workerCount = count;
+}
+
 bool badName(const char *city) {
   size_t n = strlen(city);
-  for (size_t i = 0; i < n; i++) {
-    if ((city[i] >= 0 && city[i] <= 31) || city[i] == ';') {
-      return true;
+  bool control;
+  return !n || scanField(city, n, &control) != n || control;
+}
+
+uint64_t mixHash(uint64_t a, uint64_t b) {
+  __uint128_t product = (__uint128_t)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+uint64_t hashSpan(Map *map, const char *name, size_t n) {
+  uint64_t hash = map->seed ^ n;
+  uint64_t word;
+  for (; n >= sizeof(word); n -= sizeof(word), name += sizeof(word)) {
+    memcpy(&word, name, sizeof(word));
+    hash = mixHash(hash ^ word, HASH_KEY);
+  }
+  word = 0;
+  memcpy(&word, name, n);
+  return mixHash(hash ^ word, HASH_KEY ^ map->seed);
+}
+
+uint64_t hashName(Map *map, const char *name) {
+  return hashSpan(map, name, strlen(name));
+}
+
+City *findSpan(Map *map, const char *city, size_t n, uint64_t hash) {
+  size_t mask = map->slotCount - 1;
+  size_t i = (uint32_t)hash & mask;
+  const char *name;
+  while (map->slots[i].id != NO_CITY) {
+    if (map->slots[i].hash == (uint32_t)hash) {
+      name = cityAt(map, map->slots[i].id)->name;
+      if (!strncmp(name, city, n) && !name[n]) {
+        return cityAt(map, map->slots[i].id);
+      }
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+City *findCity(Map *map, const char *city, uint64_t hash) {
+  return findSpan(map, city, strlen(city), hash);
+}
+
+City *cityExists(Map *map, const char *city) {
+  return findCity(map, city, hashName(map, city));
+}
+
+void placeCity(Map *map, uint32_t hash, uint32_t id) {
+  size_t mask = map->slotCount - 1;
+  size_t i = hash & mask;
+  while (map->slots[i].id != NO_CITY) {
+    i = (i + 1) & mask;
+  }
+  map->slots[i].hash = hash;
+  map->slots[i].id = id;
+}
+
+void growSlots(Map *map) {
+  Slot *old = map->slots;
+  size_t count = map->slotCount;
+  map->slotCount *= 2;
+  map->slots = malloc(map->slotCount * sizeof(Slot));
+  memset(map->slots, 0xff, map->slotCount * sizeof(Slot));
+  for (size_t i = 0; i < count; i++) {
+    if (old[i].id != NO_CITY) {
+      placeCity(map, old[i].hash, old[i].id);
+    }
+  }
+  free(old);
+}
+
+char *storeName(Map *map, const char *city, size_t length) {
+  size_t n = length + 1;
+  NameChunk *chunk = map->names;
+  if (!chunk || chunk->size - chunk->used < n) {
+    size_t size = n > NAME_CHUNK ? n : NAME_CHUNK;
+    chunk = malloc(sizeof(NameChunk) + size);
+    chunk->next = map->names;
+    chunk->used = 0;
+    chunk->size = size;
+    map->names = chunk;
+  }
+  char *name = chunk->data + chunk->used;
+  memcpy(name, city, length);
+  name[length] = '\0';
+  chunk->used += n;
+  return name;
+}
+
+City *insertSpan(Map *map, const char *city, size_t n, uint64_t hash) {
+  if (4 * ((size_t)map->cityCount + 1) > 3 * map->slotCount) {
+    growSlots(map);
+  }
+  if (map->cityCount % CITY_BLOCK == 0) {
+    map->blocks = realloc(map->blocks, (map->cityCount / CITY_BLOCK + 1) *
+                                       sizeof(City *));
+    map->blocks[map->cityCount / CITY_BLOCK] =
+        malloc(CITY_BLOCK * sizeof(City));
+  }
+  City *aux = cityAt(map, map->cityCount);
+  aux->id = map->cityCount;
+  aux->name = storeName(map, city, n);
+  aux->edges = NULL;
+  aux->landmarks = NULL;
+  aux->rank = NO_RANK;
+  placeCity(map, hash, aux->id);
+  map->cityCount++;
+  return aux;
+}
+
+City *insertCity(Map *map, const char *city, uint64_t hash) {
+  return insertSpan(map, city, strlen(city), hash);
+}
+
+City *obtainCity(Map *map, const char *city) {
+  uint64_t hash = hashName(map, city);
+  City *aux = findCity(map, city, hash);
+  return aux ? aux : insertCity(map, city, hash);
+}
+
+bool betweenSlots(size_t home, size_t from, size_t to) {
+  return from <= to ? from < home && home <= to : from < home || home <= to;
+}
+
+void unplaceCity(Map *map, uint32_t hash, uint32_t id) {
+  size_t mask = map->slotCount - 1;
+  size_t i = hash & mask, j;
+  while (map->slots[i].id != id) {
+    i = (i + 1) & mask;
+  }
+  j = i;
+  while (true) {
+    j = (j + 1) & mask;
+    if (map->slots[j].id == NO_CITY) {
+      break;
+    }
+    if (!betweenSlots(map->slots[j].hash & mask, i, j)) {
+      map->slots[i] = map->slots[j];
+      i = j;
     }
   }
-  return n == 0;
+  map->slots[i].id = NO_CITY;
 }
 
-int MOD(int x, int mod) {
-  while (x < 0) {
-    x += mod;
+void dropCities(Map *map, uint32_t count) {
+  City *aux;
+  NameChunk *chunk;
+  while (map->cityCount > count) {
+    aux = cityAt(map, map->cityCount - 1);
+    unplaceCity(map, hashName(map, aux->name), aux->id);
+    freeEdges(aux->edges);
+    free(aux->landmarks);
+    chunk = map->names;
+    chunk->used -= strlen(aux->name) + 1;
+    if (!chunk->used) {
+      map->names = chunk->next;
+      free(chunk);
+    }
+    map->cityCount--;
+    if (map->cityCount % CITY_BLOCK == 0) {
+      free(map->blocks[map->cityCount / CITY_BLOCK]);
+    }
   }
-  return x;
 }
 
-int hashIt(const char *s) {
-  size_t n = strlen(s);
-  int mod = N;
-  int base = 1453;
-  int hash = 0;
-  for (size_t i = 0; i < n; i++) {
-    hash = (hash + ((1LL * MOD((int)s[i], mod) * base) % mod)) % mod;
-    base = (base * 1453) % mod;
+uint64_t roadKey(City *city1, City *city2) {
+  if (city1->id > city2->id) {
+    return (uint64_t)city2->id << 32 | city1->id;
   }
-  return hash;
+  return (uint64_t)city1->id << 32 | city2->id;
 }
 
-City *cityExists(Map *map, const char *city) {
-  int hash = hashIt(city);
-  City *aux = map->cities[hash];
-  while (aux) {
-    if (!strcmp(aux->name, city)) {
-      return aux;
+size_t roadSlotOf(Map *map, uint64_t key) {
+  return mixHash(key ^ map->seed, HASH_KEY) & (map->roadSlotCount - 1);
+}
+
+Road *isConnected(Map *map, City *city1, City *city2) {
+  uint64_t key = roadKey(city1, city2);
+  size_t i = roadSlotOf(map, key);
+  while (map->roadSlots[i].road) {
+    if (map->roadSlots[i].key == key) {
+      return map->roadSlots[i].road;
     }
-    aux = aux->next;
+    i = (i + 1) & (map->roadSlotCount - 1);
   }
   return NULL;
 }
 
-char *makeCopy(const char *city) {
-  size_t n = strlen(city);
-  char *copy = malloc(n + 1);
-  for (size_t i = 0; i < n; i++) {
-    copy[i] = city[i];
+void placeRoad(Map *map, uint64_t key, Road *road) {
+  size_t i = roadSlotOf(map, key);
+  while (map->roadSlots[i].road) {
+    i = (i + 1) & (map->roadSlotCount - 1);
   }
-  copy[n] = '\0';
-  return copy;
+  map->roadSlots[i].key = key;
+  map->roadSlots[i].road = road;
 }
 
-City *addCity(Map *map, const char *city) {
-  int hash = hashIt(city);
-  City *where = map->cities[hash];
-  City *aux = malloc(sizeof(City));
-  aux->allowed = true;
-  aux->name = makeCopy(city);
-  aux->edges = NULL;
-  aux->heapNode = NULL;
-  aux->next = where;
-  map->cities[hash] = aux;
-  return aux;
+void growRoadSlots(Map *map) {
+  RoadSlot *old = map->roadSlots;
+  size_t count = map->roadSlotCount;
+  map->roadSlotCount *= 2;
+  map->roadSlots = calloc(map->roadSlotCount, sizeof(RoadSlot));
+  for (size_t i = 0; i < count; i++) {
+    if (old[i].road) {
+      placeRoad(map, old[i].key, old[i].road);
+    }
+  }
+  free(old);
 }
 
-Road *isConnected(City *city1, City *city2) {
-  Edges *edges = city1->edges;
-  while (edges) {
-    if (edges->road->from == city2 || edges->road->to == city2) {
-      return edges->road;
+void indexRoad(Map *map, Road *road) {
+  if (4 * (map->roadCount + 1) > 3 * map->roadSlotCount) {
+    growRoadSlots(map);
+  }
+  placeRoad(map, roadKey(road->from, road->to), road);
+  map->roadCount++;
+}
+
+void unindexRoad(Map *map, Road *road) {
+  size_t mask = map->roadSlotCount - 1;
+  size_t i = roadSlotOf(map, roadKey(road->from, road->to)), j, home;
+  while (map->roadSlots[i].road != road) {
+    i = (i + 1) & mask;
+  }
+  for (j = (i + 1) & mask; map->roadSlots[j].road; j = (j + 1) & mask) {
+    home = roadSlotOf(map, map->roadSlots[j].key);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      map->roadSlots[i] = map->roadSlots[j];
+      i = j;
     }
-    edges = edges->next;
   }
-  return NULL;
+  map->roadSlots[i].road = NULL;
+  map->roadCount--;
 }
 
-void addEdge(City *city, Road *road) {
-  Edges *help = malloc(sizeof(Edges));
-  help->road = road;
+void linkEdge(City *city, Edges *help) {
   help->next = city->edges;
   if (city->edges) {
     city->edges->prev = help;
@@ -162,40 +574,53 @@ void addEdge(City *city, Road *road) {
   city->edges = help;
 }
 
-void connectCities(Map *map, City *city1, City *city2,
-                   unsigned length, int builtYear) {
+Road *makeRoad(City *city1, City *city2, unsigned length, int builtYear,
+               Edges **edges) {
   Road *aux = malloc(sizeof(Road));
   aux->from = city1;
   aux->to = city2;
   aux->length = length;
   aux->year = builtYear;
-  aux->routes = NULL;
-  aux->prev = NULL;
-  aux->next = map->roads;
-  if (map->roads) {
-    map->roads->prev = aux;
+  emptyRoutes(&aux->routes);
+  for (int i = 0; i < 2; i++) {
+    edges[i] = malloc(sizeof(Edges));
+    edges[i]->road = aux;
   }
-  map->roads = aux;
-  addEdge(city1, aux);
-  addEdge(city2, aux);
+  return aux;
 }
 
-bool addRoad(Map *map, const char *city1, const char *city2,
-             unsigned length, int builtYear) {
-  if (badName(city1) || badName(city2) || !builtYear || !length) {
+void linkRoad(Map *map, Road *road, Edges **edges) {
+  road->prev = NULL;
+  road->next = map->roads;
+  if (map->roads) {
+    map->roads->prev = road;
+  }
+  map->roads = road;
+  map->landmarksStale = true;
+  map->hierarchyStale = true;
+  indexRoad(map, road);
+  linkEdge(road->from, edges[0]);
+  linkEdge(road->to, edges[1]);
+}
+
+Road *connectCities(Map *map, City *city1, City *city2,
+                    unsigned length, int builtYear) {
+  Edges *edges[2];
+  Road *aux = makeRoad(city1, city2, length, builtYear, edges);
+  linkRoad(map, aux, edges);
+  return aux;
+}
+
+bool addValidRoad(Map *map, const char *city1, const char *city2,
+                  unsigned length, int builtYear) {
+  if (!builtYear || !length) {
     return false;
   }
   if (!strcmp(city1, city2)) {
     return false;
   }
-  City *first = cityExists(map, city1), *second = cityExists(map, city2);
-  if (!first) {
-    first = addCity(map, city1);
-  }
-  if (!second) {
-    second = addCity(map, city2);
-  }
-  Road *road = isConnected(first, second);
+  City *first = obtainCity(map, city1), *second = obtainCity(map, city2);
+  Road *road = isConnected(map, first, second);
   if (road) {
     return false;
   }
@@ -203,9 +628,17 @@ bool addRoad(Map *map, const char *city1, const char *city2,
   return true;
 }
 
-bool repairRoad(Map *map, const char *city1,
-                const char *city2, int repairYear){
-  if (badName(city1) || badName(city2) || !repairYear) {
+bool addRoad(Map *map, const char *city1, const char *city2,
+             unsigned length, int builtYear) {
+  if (badName(city1) || badName(city2)) {
+    return false;
+  }
+  return addValidRoad(map, city1, city2, length, builtYear);
+}
+
+bool repairValidRoad(Map *map, const char *city1,
+                     const char *city2, int repairYear) {
+  if (!repairYear) {
     return false;
   }
   if (!strcmp(city1, city2)) {
@@ -216,7 +649,7 @@ bool repairRoad(Map *map, const char *city1,
   if (!first || !second) {
     return false;
   }
-  Road *go = isConnected(first, second);
+  Road *go = isConnected(map, first, second);
   if (!go) {
     return false;
   }
@@ -227,6 +660,14 @@ bool repairRoad(Map *map, const char *city1,
   return true;
 }
 
+bool repairRoad(Map *map, const char *city1,
+                const char *city2, int repairYear){
+  if (badName(city1) || badName(city2)) {
+    return false;
+  }
+  return repairValidRoad(map, city1, city2, repairYear);
+}
+
 bool maxi(int x, int y) {
   return x >= y;
 }
@@ -243,179 +684,372 @@ City *toCity(Road *road, City *from) {
   }
 }
 
-void dijkstra(Heap *Q, Road *banned) {
+void clearMask(Mask *mask) {
+  if (!++mask->epoch) {
+    memset(mask->stamps, 0, mask->capacity * sizeof(uint32_t));
+    mask->epoch = 1;
+  }
+}
+
+void blockCity(Mask *mask, City *city) {
+  if (city->id >= mask->capacity) {
+    uint32_t capacity = mask->capacity ? mask->capacity : 16;
+    while (capacity <= city->id) {
+      capacity *= 2;
+    }
+    mask->stamps = realloc(mask->stamps, capacity * sizeof(uint32_t));
+    memset(mask->stamps + mask->capacity, 0,
+           (capacity - mask->capacity) * sizeof(uint32_t));
+    mask->capacity = capacity;
+  }
+  mask->stamps[city->id] = mask->epoch;
+}
+
+void allowCity(Mask *mask, City *city) {
+  if (city->id < mask->capacity) {
+    mask->stamps[city->id] = 0;
+  }
+}
+
+bool blockedCity(Mask *mask, City *city) {
+  return mask && city->id < mask->capacity &&
+         mask->stamps[city->id] == mask->epoch;
+}
+
+void blockRoute(Mask *mask, Route *route) {
+  clearMask(mask);
+  blockCity(mask, route->start);
+  for (size_t i = 0; i < route->size; i++) {
+    blockCity(mask, stepEnd(routeStep(route, i)));
+  }
+}
+
+bool passable(Mask *mask, Road *road, City *city, Road *banned) {
+  return road != banned && !blockedCity(mask, city);
+}
+
+void relax(Heap *Q, HeapNode *best, Road *road, City *city) {
+  HeapNode *node = cityNode(Q, city);
+  uint64_t distance = best->distance + road->length;
+  int year = getMini(best->year, road->year);
+  if (!node) {
+    node = insertHeap(Q, city, distance, year);
+    node->from = road;
+    node->ties = 1;
+  } else if (!node->visited && (distance < node->distance ||
+             (distance == node->distance && maxi(year, node->year)))) {
+    if (distance == node->distance && year == node->year) {
+      node->ties += node->ties < 2;
+    } else {
+      node->ties = 1;
+    }
+    decreaseValue(Q, node, distance, year);
+    node->from = road;
+  }
+}
+
+void settleTies(Heap *Q, HeapNode *node) {
+  node->tied = node->ties > 1 || (node->from &&
+               cityNode(Q, toCity(node->from, node->city))->tied);
+}
+
+bool dijkstra(Heap *Q, Mask *mask, City *destination, Road *banned) {
   HeapNode *best;
   Edges *adj;
-  Road *adjRoad;
   City *adjCity;
-  while (Q->root) {
+  while (!emptyHeap(Q)) {
     best = minHeap(Q);
+    settleTies(Q, best);
+    if (best->city == destination) {
+      return true;
+    }
     adj = best->city->edges;
     while (adj) {
-      adjRoad = adj->road;
-      adjCity = toCity(adjRoad, best->city);
-      if (adjRoad != banned && adjCity->allowed &&
-          !adjCity->heapNode->visited ) {
-        if (best->distance + adjRoad->length < adjCity->heapNode->distance) {
-          decreaseValue(adjCity->heapNode, best->distance + adjRoad->length,
-                        getMini(best->year, adjRoad->year));
-          adjCity->heapNode->from = adjRoad;
-        } else if (best->distance + adjRoad->length == adjCity->heapNode->distance) {
-          if (maxi(getMini(best->year, adjRoad->year), adjCity->heapNode->year)) {
-            decreaseValue(adjCity->heapNode, best->distance + adjRoad->length,
-                          getMini(best->year, adjRoad->year));
-            adjCity->heapNode->from = adjRoad;
-          }
-        }
+      adjCity = toCity(adj->road, best->city);
+      if (passable(mask, adj->road, adjCity, banned)) {
+        relax(Q, best, adj->road, adjCity);
       }
       adj = adj->next;
     }
   }
+  return false;
 }
 
-bool checkUnique(Route *route, Road *banned) {
-  City *start = route->start;
-  City *helpCity;
-  City *nextCity;
-  City *prevCity = NULL;
-  Edges *edges = route->edges;
-  Edges *helpEdges;
-  while (start) {
-    if (edges) {
-      nextCity = toCity(edges->road, start);
-    } else {
-      nextCity = NULL;
-    }
-    helpEdges = start->edges;
-    while (helpEdges) {
-      helpCity = toCity(helpEdges->road, start);
-      if (helpEdges->road != banned && helpCity->allowed &&
-          helpCity->heapNode && helpCity != nextCity && helpCity != prevCity) {
-        if (helpCity->heapNode->distance + helpEdges->road->length == start->heapNode->distance &&
-            getMini(helpCity->heapNode->year, helpEdges->road->year) == start->heapNode->year) {
-          return false;
-        }
-      }
-      helpEdges = helpEdges->next;
-    }
-    if (edges) {
-      prevCity = start;
-      start = toCity(edges->road, start);
-      edges = edges->next;
-    } else {
-      start = NULL;
-    }
+Route *makeRoute(Heap *Q, City *source, City *destination) {
+  Route *ret = startRoute(source);
+  Road *from;
+  ret->end = destination;
+  ret->totalCost = cityNode(Q, destination)->distance;
+  ret->year = cityNode(Q, destination)->year;
+  City *traverse = destination;
+  while ((from = cityNode(Q, traverse)->from)) {
+    pushFront(ret, from, from->to == traverse);
+    traverse = toCity(from, traverse);
   }
-  return true;
+  return ret;
 }
 
-Route *makeRoute(City *source, City *destination) {
-  Edges *edgesHelp;
-  Route *ret = malloc(sizeof(Route));
-  ret->start = source;
-  ret->end = destination;
-  ret->edges = NULL;
-  ret->totalCost = destination->heapNode->distance;
-  ret->year = destination->heapNode->year;
-  City *traverse = destination;
-  while (traverse) {
-    if (traverse->heapNode->from) {
-      edgesHelp = malloc(sizeof(Edges));
-      edgesHelp->road = traverse->heapNode->from;
-      edgesHelp->next = ret->edges;
-      if (ret->edges) {
-        ret->edges->prev = edgesHelp;
+bool guided(Map *map) {
+  return (map->landmarkCount && !map->landmarksStale) ||
+         (map->hierarchy && !map->hierarchyStale);
+}
+
+uint64_t landmarkEstimate(void *goal, City *city) {
+  Goal *aim = goal;
+  uint64_t *from = city->landmarks, *to = aim->target->landmarks;
+  uint64_t best = 0, diff;
+  if (!from || !to) {
+    return 0;
+  }
+  for (unsigned i = 0; i < aim->map->landmarkCount; i++) {
+    if (from[i] != UINT64_MAX && to[i] != UINT64_MAX) {
+      diff = from[i] > to[i] ? from[i] - to[i] : to[i] - from[i];
+      if (diff > best) {
+        best = diff;
       }
-      ret->edges = edgesHelp;
-      traverse = toCity(traverse->heapNode->from, traverse);
-    } else {
-      traverse = NULL;
     }
   }
-  ret->edges->prev = NULL;
+  return best;
+}
+
+uint64_t hierarchyEstimate(void *goal, City *city) {
+  Goal *aim = goal;
+  uint64_t distance;
+  if (city->rank == NO_RANK) {
+    return UNREACHABLE;
+  }
+  distance = distanceToTarget(aim->map->hierarchy, city->rank);
+  return distance == UINT64_MAX ? UNREACHABLE : distance;
+}
+
+Heap *searchHeap(Map *map, Scratch *scratch, City *source, Goal *goal,
+                 bool backward) {
+  Heap *Q;
+  resetScratch(scratch, map->cityCount, backward);
+  if (map->hierarchy && !map->hierarchyStale &&
+      goal->target->rank != NO_RANK) {
+    aimHierarchy(map->hierarchy, goal->target->rank);
+    Q = newHeap(scratch, source, DARY_HEAP, false);
+    guideHeap(Q, hierarchyEstimate, goal);
+  } else if (map->landmarkCount && !map->landmarksStale) {
+    Q = newHeap(scratch, source, DARY_HEAP, false);
+    guideHeap(Q, landmarkEstimate, goal);
+  } else {
+    Q = newHeap(scratch, source, map->engine, false);
+  }
+  return Q;
+}
+
+Route *startDijkstra(Map *map, Scratch *scratch, Mask *mask, City *source,
+                     City *destination, Road *banned) {
+  Goal goal = {map, destination};
+  Heap *Q = searchHeap(map, scratch, source, &goal, false);
+  Route *ret = NULL;
+  if (dijkstra(Q, mask, destination, banned) &&
+      !cityNode(Q, destination)->tied) {
+    ret = makeRoute(Q, source, destination);
+  }
+  freeHeap(Q);
   return ret;
 }
 
-void addHeap(Heap *Q, City *source, Road *banned) {
-  Edges *edges;
+uint64_t meetSearches(Heap *forward, Heap *backward, Road *banned,
+                      HeapNode ***settled, size_t *count) {
+  uint64_t best = UINT64_MAX;
+  size_t capacity = 16;
+  Heap *Q, *other;
+  HeapNode *node, *meet;
+  Edges *adj;
   City *adjCity;
-  edges = source->edges;
-  while (edges) {
-    adjCity = toCity(edges->road, source);
-    if (edges->road != banned && !adjCity->heapNode && adjCity->allowed) {
-      insertHeap(Q, adjCity);
-      addHeap(Q, adjCity, banned);
+  *settled = malloc(capacity * sizeof(HeapNode *));
+  *count = 0;
+  while (!emptyHeap(forward) && !emptyHeap(backward)) {
+    uint64_t ahead = topHeap(forward)->distance;
+    uint64_t behind = topHeap(backward)->distance;
+    if (best != UINT64_MAX && ahead + behind > best) {
+      break;
+    }
+    Q = ahead <= behind ? forward : backward;
+    other = ahead <= behind ? backward : forward;
+    node = minHeap(Q);
+    if (Q == forward) {
+      settleTies(Q, node);
+    } else {
+      if (*count == capacity) {
+        capacity *= 2;
+        *settled = realloc(*settled, capacity * sizeof(HeapNode *));
+      }
+      (*settled)[(*count)++] = node;
+    }
+    adj = node->city->edges;
+    while (adj) {
+      adjCity = toCity(adj->road, node->city);
+      if (passable(NULL, adj->road, adjCity, banned)) {
+        relax(Q, node, adj->road, adjCity);
+        meet = cityNode(other, adjCity);
+        if (meet && node->distance + adj->road->length + meet->distance < best) {
+          best = node->distance + adj->road->length + meet->distance;
+        }
+      }
+      adj = adj->next;
     }
-    edges = edges->next;
   }
+  return best;
 }
 
-void freeNodes(Heap *Q, City *source, Road *banned) {
-  Edges *edges;
+void completeForward(Heap *forward, HeapNode **settled, size_t count,
+                     uint64_t total, Road *banned) {
+  HeapNode *node, *ahead, *prev;
+  Edges *adj;
   City *adjCity;
-  edges = source->edges;
-  free(source->heapNode);
-  source->heapNode = NULL;
-  while (edges) {
-    adjCity = toCity(edges->road, source);
-    if (edges->road != banned && adjCity->heapNode) {
-      freeNodes(Q, adjCity, banned);
+  Road *from;
+  uint64_t distance;
+  int year, use;
+  unsigned ties;
+  bool tied;
+  for (size_t i = count; i-- > 0;) {
+    node = settled[i];
+    ahead = cityNode(forward, node->city);
+    if (node->distance > total || (ahead && ahead->visited)) {
+      continue;
+    }
+    distance = total - node->distance;
+    from = NULL;
+    year = 0;
+    ties = 0;
+    tied = false;
+    adj = node->city->edges;
+    while (adj) {
+      adjCity = toCity(adj->road, node->city);
+      prev = cityNode(forward, adjCity);
+      if (passable(NULL, adj->road, adjCity, banned) && prev &&
+          prev->visited &&
+          prev->distance + adj->road->length == distance) {
+        use = getMini(prev->year, adj->road->year);
+        if (from && use == year) {
+          ties++;
+          tied = tied || prev->tied;
+        } else if (!from || use > year) {
+          from = adj->road;
+          year = use;
+          ties = 1;
+          tied = prev->tied;
+        }
+      }
+      adj = adj->next;
+    }
+    if (from) {
+      ahead = touchNode(forward, node->city);
+      ahead->distance = distance;
+      ahead->year = year;
+      ahead->from = from;
+      ahead->visited = true;
+      ahead->tied = ties > 1 || tied;
     }
-    edges = edges->next;
   }
 }
 
-Route *startDijkstra(City *source, City *destination, Road *banned) {
-  Heap *Q = newHeap(source);
-  addHeap(Q, source, banned);
-  bool ok = true;
+Route *bidirectionalDijkstra(Map *map, City *source, City *destination,
+                             Road *banned) {
+  resetScratch(&map->scratch, map->cityCount, true);
+  Heap *forward = newHeap(&map->scratch, source, map->engine, false);
+  Heap *backward = newHeap(&map->scratch, destination, map->engine, true);
+  HeapNode **settled;
+  size_t count;
   Route *ret = NULL;
-  if (destination->heapNode) {
-    dijkstra(Q, banned);
-  }
-  if (!destination->heapNode) {
-    ok = false;
-  }
-  if (ok) {
-    ret = makeRoute(source, destination);
+  uint64_t total = meetSearches(forward, backward, banned, &settled, &count);
+  if (total != UINT64_MAX) {
+    completeForward(forward, settled, count, total, banned);
+    if (!cityNode(forward, destination)->tied) {
+      ret = makeRoute(forward, source, destination);
+    }
   }
-  if (ok && !checkUnique(ret, banned)) {
-    freeRoute(ret);
-    ret = NULL;
+  free(settled);
+  freeHeap(forward);
+  freeHeap(backward);
+  return ret;
+}
+
+City **listCities(Map *map, size_t *count) {
+  City **list = malloc((map->cityCount ? map->cityCount : 1) *
+                       sizeof(City *));
+  *count = map->cityCount;
+  for (uint32_t i = 0; i < map->cityCount; i++) {
+    list[i] = cityAt(map, i);
+  }
+  return list;
+}
+
+void landmarkDistances(Map *map, City *landmark, unsigned index) {
+  resetScratch(&map->scratch, map->cityCount, false);
+  Heap *Q = newHeap(&map->scratch, landmark, map->engine, false);
+  dijkstra(Q, NULL, NULL, NULL);
+  for (size_t i = 0; i < Q->count; i++) {
+    Q->created[i]->city->landmarks[index] = Q->created[i]->distance;
   }
-  freeNodes(Q, source, banned);
   freeHeap(Q);
-  return ret;
 }
 
-bool existId(Road *road, unsigned id) {
-  Routes *routes = road->routes;
-  while (routes) {
-    if (routes->routeId == id) {
-      return true;
+void prepareLandmarks(Map *map, unsigned count) {
+  size_t size;
+  City **cities = listCities(map, &size);
+  City *landmark = size ? cities[0] : NULL;
+  uint64_t farthest, nearest;
+  map->landmarkCount = 0;
+  for (size_t i = 0; i < size; i++) {
+    free(cities[i]->landmarks);
+    cities[i]->landmarks = NULL;
+    if (count) {
+      cities[i]->landmarks = malloc(count * sizeof(uint64_t));
+      for (unsigned j = 0; j < count; j++) {
+        cities[i]->landmarks[j] = UINT64_MAX;
+      }
     }
-    routes = routes->next;
   }
-  return false;
+  while (landmark && map->landmarkCount < count) {
+    landmarkDistances(map, landmark, map->landmarkCount++);
+    landmark = NULL;
+    farthest = 0;
+    for (size_t i = 0; i < size; i++) {
+      nearest = UINT64_MAX;
+      for (unsigned j = 0; j < map->landmarkCount; j++) {
+        if (cities[i]->landmarks[j] < nearest) {
+          nearest = cities[i]->landmarks[j];
+        }
+      }
+      if (nearest > farthest) {
+        farthest = nearest;
+        landmark = cities[i];
+      }
+    }
+  }
+  map->landmarksStale = false;
+  free(cities);
 }
 
-void giveId(Route *route, unsigned routeId) {
-  Edges *edges = route->edges;
-  Routes *aux;
-  while (edges) {
-    if (!existId(edges->road, routeId)) {
-      aux = malloc(sizeof(Routes));
-      aux->routeId = routeId;
-      aux->next = edges->road->routes;
-      edges->road->routes = aux;
-    }
-    edges = edges->next;
+void prepareHierarchy(Map *map) {
+  size_t size;
+  City **cities = listCities(map, &size);
+  freeHierarchy(map->hierarchy);
+  map->hierarchy = newHierarchy(cities, size);
+  map->hierarchyStale = false;
+  free(cities);
+}
+
+void markSteps(Route *route, unsigned routeId, size_t from, size_t to) {
+  for (size_t i = from; i < to; i++) {
+    addRoute(&routeStep(route, i)->road->routes, routeId,
+             (uint32_t)i - route->head);
   }
 }
 
-bool newRoute(Map *map, unsigned routeId,
-              const char *city1, const char *city2) {
-  if (routeId > 999 || routeId <= 0 || badName(city1) || badName(city2)) {
+void giveId(Route *route, unsigned routeId) {
+  markSteps(route, routeId, 0, route->size);
+}
+
+bool newValidRoute(Map *map, unsigned routeId,
+                   const char *city1, const char *city2) {
+  if (routeId > 999 || routeId <= 0) {
     return false;
   }
   if (map->routes[routeId]) {
@@ -429,7 +1063,12 @@ bool newRoute(Map *map, unsigned routeId,
   if (!first || !second) {
     return false;
   }
-  Route *ans = startDijkstra(first, second, NULL);
+  Route *ans;
+  if (guided(map)) {
+    ans = startDijkstra(map, &map->scratch, NULL, first, second, NULL);
+  } else {
+    ans = bidirectionalDijkstra(map, first, second, NULL);
+  }
   if (!ans) {
     return false;
   } else {
@@ -439,48 +1078,78 @@ bool newRoute(Map *map, unsigned routeId,
   }
 }
 
-void switchAllowed(Route *route, bool allowed) {
-  City *start = route->start;
-  Edges *edges = route->edges;
-  while (start) {
-    start->allowed = allowed;
-    if (edges) {
-      start = toCity(edges->road, start);
-      edges = edges->next;
-    } else {
-      start = NULL;
+bool newRoute(Map *map, unsigned routeId,
+              const char *city1, const char *city2) {
+  if (badName(city1) || badName(city2)) {
+    return false;
+  }
+  return newValidRoute(map, routeId, city1, city2);
+}
+
+void extendSearch(Map *map, Mask *mask, Route *route, City *target,
+                  Route **fromHead, Route **fromTail) {
+  Goal goal = {map, target};
+  Heap *Q = searchHeap(map, &map->scratch, route->start, &goal, true);
+  HeapNode *best;
+  Edges *adj;
+  City *adjCity;
+  bool found[2] = {false, false};
+  uint64_t bound = UINT64_MAX;
+  Q->backward = true;
+  insertHeap(Q, route->end, 0, INT32_MAX);
+  *fromHead = *fromTail = NULL;
+  while (!emptyHeap(Q) && !(found[false] && found[true])) {
+    best = minHeap(Q);
+    if (nodeKey(Q, best) > bound) {
+      break;
+    }
+    if (found[best->backward]) {
+      continue;
+    }
+    Q->backward = best->backward;
+    settleTies(Q, best);
+    if (best->city == target) {
+      found[best->backward] = true;
+      Route **side = best->backward ? fromTail : fromHead;
+      if (!best->tied) {
+        *side = makeRoute(Q, best->backward ? route->end : route->start,
+                          target);
+      }
+      if (*side) {
+        bound = best->distance;
+      }
+      continue;
+    }
+    for (adj = best->city->edges; adj; adj = adj->next) {
+      adjCity = toCity(adj->road, best->city);
+      if (passable(mask, adj->road, adjCity, NULL)) {
+        relax(Q, best, adj->road, adjCity);
+      }
     }
   }
+  freeHeap(Q);
 }
 
 Route *mergeRoutes(Route *a, Route *b, bool start) {
   if (start) {
-    Edges *use = b->edges;
-    Edges *help;
-    while (use) {
-      help = use->next;
-      a->edges->prev = use;
-      use->next = a->edges;
-      use->prev = help;
-      a->edges = use;
-      use = help;
+    reserveSteps(a, b->size, 0);
+    for (size_t i = 0; i < b->size; i++) {
+      pushFront(a, routeStep(b, i)->road, !routeStep(b, i)->forward);
     }
     a->start = b->end;
   } else {
-    Edges *find = a->edges;
-    while (find->next) {
-      find = find->next;
+    reserveSteps(a, 0, b->size);
+    for (size_t i = 0; i < b->size; i++) {
+      pushBack(a, routeStep(b, i)->road, routeStep(b, i)->forward);
     }
-    b->edges->prev = find;
-    find->next = b->edges;
     a->end = b->end;
   }
-  free(b);
+  freeRoute(b);
   return a;
 }
 
-bool extendRoute(Map *map, unsigned routeId, const char *city) {
-  if (routeId > 999 || badName(city)) {
+bool extendValidRoute(Map *map, unsigned routeId, const char *city) {
+  if (routeId > 999) {
     return false;
   }
   if (!map->routes[routeId]) {
@@ -491,17 +1160,14 @@ bool extendRoute(Map *map, unsigned routeId, const char *city) {
     return false;
   }
   Route *my = map->routes[routeId];
-  switchAllowed(map->routes[routeId], false);
-  if (!first->allowed) {
-    switchAllowed(my, true);
+  Route *fromHead, *fromTail;
+  size_t size = my->size;
+  uint32_t head = my->head;
+  blockRoute(&map->mask, my);
+  if (blockedCity(&map->mask, first)) {
     return false;
   }
-  my->start->allowed = true;
-  Route *fromHead = startDijkstra(my->start, first, NULL);
-  my->start->allowed = false;
-  my->end->allowed = true;
-  Route *fromTail = startDijkstra(my->end, first, NULL);
-  switchAllowed(my, true);
+  extendSearch(map, &map->mask, my, first, &fromHead, &fromTail);
   if (!fromHead && !fromTail) {
     return false;
   }
@@ -534,10 +1200,18 @@ bool extendRoute(Map *map, unsigned routeId, const char *city) {
       }
     }
   }
-  giveId(map->routes[routeId], routeId);
+  markSteps(my, routeId, 0, my->head - head);
+  markSteps(my, routeId, size + my->head - head, my->size);
   return true;
 }
 
+bool extendRoute(Map *map, unsigned routeId, const char *city) {
+  if (badName(city)) {
+    return false;
+  }
+  return extendValidRoute(map, routeId, city);
+}
+
 void deleteEdge(City *city, Road *road) {
   Edges *edges = city->edges;
   bool found = false;
@@ -564,58 +1238,120 @@ void deleteEdge(City *city, Road *road) {
   }
 }
 
-void changeRoute(Route *route, Route *with, Road *road, City *from) {
-  bool found = false;
-  Edges *edges = route->edges;
-  Edges *use, *help, *last;
-  Edges *lastWith = with->edges;
-  City *start = route->start;
-  while (lastWith->next) {
-    lastWith = lastWith->next;
+size_t routePosition(Route *route, Road *road, unsigned routeId) {
+  return (uint32_t)(routeSpot(&road->routes, routeId) + route->head);
+}
+
+void searchDetours(Repair *repair, Scratch *scratch, Mask *mask) {
+  size_t i;
+  while (!atomic_load(&repair->failed) &&
+         (i = atomic_fetch_add(&repair->next, 1)) < repair->count) {
+    blockRoute(mask, repair->map->routes[repair->ids[i]]);
+    allowCity(mask, repair->source);
+    allowCity(mask, repair->target);
+    repair->detours[i] = startDijkstra(repair->map, scratch, mask,
+                                       repair->source, repair->target,
+                                       repair->road);
+    if (!repair->detours[i]) {
+      atomic_store(&repair->failed, true);
+    }
   }
-  while (!found && edges) {
-    if (edges->road == road) {
-      if (start == from) {
-        if (edges->prev) {
-          edges->prev->next = with->edges;
-          with->edges->prev = edges->prev;
-        } else {
-          route->edges = with->edges;
-          with->edges->prev = NULL;
-        }
-        lastWith->next = edges->next;
-        if (edges->next) {
-          edges->next->prev = lastWith;
-        }
-      } else {
-        use = with->edges;
-        last = edges->next;
-        while (use) {
-          help = use->next;
-          use->next = last;
-          use->prev = help;
-          last = use;
-          use = help;
-        }
-        if (edges->prev) {
-          edges->prev->next = lastWith;
-          lastWith->prev = edges->prev;
-        } else {
-          route->edges = lastWith;
-          lastWith->prev = NULL;
-        }
-        if (edges->next) {
-          edges->next->prev = with->edges;
-        }
-      }
-      free(edges);
-      found = true;
+}
+
+void *detourThread(void *data) {
+  Worker *worker = data;
+  Map *map = worker->map;
+  Repair *repair;
+  pthread_mutex_lock(&map->poolLock);
+  while (true) {
+    while (!map->closing && (worker->round == map->repairRound ||
+                             worker->index >= map->helpers)) {
+      pthread_cond_wait(&map->poolWake, &map->poolLock);
     }
-    if (!found) {
-      start = toCity(edges->road, start);
-      edges = edges->next;
+    if (map->closing) {
+      break;
+    }
+    worker->round = map->repairRound;
+    repair = map->repair;
+    pthread_mutex_unlock(&map->poolLock);
+    searchDetours(repair, &worker->scratch, &worker->mask);
+    if (worker->scratch.capacity[false] > WORKER_KEEP) {
+      freeScratch(&worker->scratch);
+    }
+    if (worker->mask.capacity > WORKER_KEEP) {
+      free(worker->mask.stamps);
+      emptyMask(&worker->mask);
+    }
+    pthread_mutex_lock(&map->poolLock);
+    if (!--map->busy) {
+      pthread_cond_signal(&map->poolDone);
+    }
+  }
+  pthread_mutex_unlock(&map->poolLock);
+  return NULL;
+}
+
+bool startWorker(Map *map) {
+  Worker *worker = &map->workers[map->startedWorkers];
+  worker->map = map;
+  worker->index = map->startedWorkers;
+  worker->round = map->repairRound;
+  if (pthread_create(&worker->thread, NULL, detourThread, worker)) {
+    return false;
+  }
+  map->startedWorkers++;
+  return true;
+}
+
+void findDetours(Map *map, Repair *repair) {
+  unsigned helpers = 0;
+  size_t wanted = map->workerCount < repair->count ? map->workerCount
+                                                   : repair->count;
+  if (map->hierarchy && !map->hierarchyStale) {
+    wanted = 1;
+  }
+  while (map->startedWorkers + 1 < wanted && startWorker(map)) {
+  }
+  if (wanted > 1) {
+    helpers = wanted - 1 < map->startedWorkers ? wanted - 1
+                                                : map->startedWorkers;
+  }
+  if (helpers) {
+    pthread_mutex_lock(&map->poolLock);
+    map->repair = repair;
+    map->helpers = map->busy = helpers;
+    map->repairRound++;
+    pthread_cond_broadcast(&map->poolWake);
+    pthread_mutex_unlock(&map->poolLock);
+  }
+  searchDetours(repair, &map->scratch, &map->mask);
+  if (helpers) {
+    pthread_mutex_lock(&map->poolLock);
+    while (map->busy) {
+      pthread_cond_wait(&map->poolDone, &map->poolLock);
+    }
+    map->repair = NULL;
+    map->helpers = 0;
+    pthread_mutex_unlock(&map->poolLock);
+  }
+}
+
+void changeRoute(Route *route, Route *with, size_t i, City *from) {
+  Road *road = routeStep(route, i)->road;
+  bool along = (routeStep(route, i)->forward ? road->from : road->to) == from;
+  reserveSteps(route, 0, with->size - 1);
+  memmove(routeStep(route, i + with->size), routeStep(route, i + 1),
+          (route->size - i - 1) * sizeof(Step));
+  for (size_t j = 0; j < with->size; j++) {
+    if (along) {
+      *routeStep(route, i + j) = *routeStep(with, j);
+    } else {
+      routeStep(route, i + j)->road = routeStep(with, with->size - 1 - j)->road;
+      routeStep(route, i + j)->forward =
+          !routeStep(with, with->size - 1 - j)->forward;
     }
   }
+  route->size += with->size - 1;
 }
 
 void deleteRoad(Map *map, Road *road) {
@@ -630,55 +1366,64 @@ void deleteRoad(Map *map, Road *road) {
       map->roads->prev = NULL;
     }
   }
-  if (road->routes) {
-    freeRoutes(road->routes);
-  }
+  map->landmarksStale = true;
+  map->hierarchyStale = true;
+  unindexRoad(map, road);
+  freeRoutes(&road->routes);
   free(road);
 }
 
-bool removeRoad(Map *map, const char *city1, const char *city2) {
-  if (badName(city1) || badName(city2)) {
-    return false;
-  }
+bool removeValidRoad(Map *map, const char *city1, const char *city2) {
   City *first = cityExists(map, city1);
   City *second = cityExists(map, city2);
   if ((!first || !second) || (first == second)) {
     return false;
   }
-  Road *connects = isConnected(first, second);
+  Road *connects = isConnected(map, first, second);
   if (!connects) {
     return false;
   }
-  if (!connects->routes) {
+  if (!connects->routes.size) {
     deleteEdge(first, connects);
     deleteEdge(second, connects);
     deleteRoad(map, connects);
     return true;
   }
-  Routes *use;
-  Route *new = NULL;
-  use = connects->routes;
-  while (use) {
-    switchAllowed(map->routes[use->routeId], false);
-    first->allowed = second->allowed = true;
-    new = startDijkstra(first, second, connects);
-    switchAllowed(map->routes[use->routeId], true);
-    if (!new) {
-      return false;
-    }
-    freeRoute(new);
-    use = use->next;
-  }
-  use = connects->routes;
-  while (use) {
-    switchAllowed(map->routes[use->routeId], false);
-    first->allowed = second->allowed = true;
-    new = startDijkstra(first, second, connects);
-    changeRoute(map->routes[use->routeId], new, connects, first);
-    switchAllowed(map->routes[use->routeId], true);
-    giveId(map->routes[use->routeId], use->routeId);
-    free(new);
-    use = use->next;
+  RouteSet *use = &connects->routes;
+  Repair repair;
+  size_t at, count = 0;
+  repair.map = map;
+  repair.road = connects;
+  repair.source = first;
+  repair.target = second;
+  repair.ids = malloc(use->size * sizeof(unsigned));
+  repair.detours = calloc(use->size, sizeof(Route *));
+  atomic_init(&repair.next, 0);
+  atomic_init(&repair.failed, false);
+  for (unsigned id = nextRoute(use, R); id != R; id = nextRoute(use, id)) {
+    repair.ids[count++] = id;
+  }
+  repair.count = count;
+  findDetours(map, &repair);
+  if (atomic_load(&repair.failed)) {
+    for (size_t i = 0; i < repair.count; i++) {
+      if (repair.detours[i]) {
+        freeRoute(repair.detours[i]);
+      }
+    }
+  } else {
+    for (size_t i = 0; i < repair.count; i++) {
+      Route *route = map->routes[repair.ids[i]];
+      at = routePosition(route, connects, repair.ids[i]);
+      changeRoute(route, repair.detours[i], at, first);
+      markSteps(route, repair.ids[i], at, route->size);
+      freeRoute(repair.detours[i]);
+    }
+  }
+  free(repair.ids);
+  free(repair.detours);
+  if (atomic_load(&repair.failed)) {
+    return false;
   }
   deleteEdge(first, connects);
   deleteEdge(second, connects);
@@ -686,41 +1431,38 @@ bool removeRoad(Map *map, const char *city1, const char *city2) {
   return true;
 }
 
+bool removeRoad(Map *map, const char *city1, const char *city2) {
+  if (badName(city1) || badName(city2)) {
+    return false;
+  }
+  return removeValidRoad(map, city1, city2);
+}
+
+size_t unsignedLen(unsigned x) {
+  size_t ret = 1;
+  while (x >= 10) {
+    ret++;
+    x /= 10;
+  }
+  return ret;
+}
+
 size_t intLen(int x) {
   if (x < 0) {
-    x *= -1;
-    size_t ret = 0;
-    while (x) {
-      ret++;
-      x /= 10;
-    }
-    ret++;
-    return ret;
-  } else {
-    size_t ret = 0;
-    while (x) {
-      ret++;
-      x /= 10;
-    }
-    return ret;
+    return unsignedLen(-(unsigned)x) + 1;
   }
+  return unsignedLen(x);
 }
 
 size_t findSize(Route *route, unsigned routeId) {
-  size_t ret = intLen(routeId) + 1;
+  size_t ret = unsignedLen(routeId) + 1;
   ret += strlen(route->start->name) + 1;
-  City *start = route->start;
-  Edges *edges = route->edges;
-  while (start) {
-    if (edges) {
-      start = toCity(edges->road, start);
-      ret += strlen(start->name) + 1;
-      ret += intLen(edges->road->year) + 1;
-      ret += intLen(edges->road->length) + 1;
-      edges = edges->next;
-    } else {
-      start = NULL;
-    }
+  Step *step;
+  for (size_t i = 0; i < route->size; i++) {
+    step = routeStep(route, i);
+    ret += strlen(stepEnd(step)->name) + 1;
+    ret += intLen(step->road->year) + 1;
+    ret += unsignedLen(step->road->length) + 1;
   }
   return ret;
 }
@@ -734,61 +1476,28 @@ const char *getRouteDescription(Map *map, unsigned routeId) {
   Route *route = map->routes[routeId];
   char *ret = calloc(findSize(route, routeId), sizeof(char));
   size_t total_size = 0;
-  sprintf(ret + total_size, "%u%c", routeId, ';');
-  total_size += intLen(routeId) + 1;
-  City *start = route->start;
-  Edges *edges = route->edges;
-  sprintf(ret + total_size, "%s%c", route->start->name, ';');
-  total_size += strlen(route->start->name) + 1;
-  while (start) {
-    if (edges) {
-      start = toCity(edges->road, start);
-      sprintf(ret + total_size, "%u%c", edges->road->length, ';');
-      total_size += intLen(edges->road->length) + 1;
-      sprintf(ret + total_size, "%d%c", edges->road->year, ';');
-      total_size += intLen(edges->road->year) + 1;
-      edges = edges->next;
-      if (edges) {
-        sprintf(ret + total_size, "%s%c", start->name, ';');
-        total_size += strlen(start->name) + 1;
-      } else {
-        sprintf(ret + total_size, "%s", start->name);
-        total_size += strlen(start->name);
-      }
-    } else {
-      start = NULL;
-    }
+  Step *step;
+  total_size += sprintf(ret + total_size, "%u;%s", routeId,
+                        route->start->name);
+  for (size_t i = 0; i < route->size; i++) {
+    step = routeStep(route, i);
+    total_size += sprintf(ret + total_size, ";%u;%d;%s", step->road->length,
+                          step->road->year, stepEnd(step)->name);
   }
   return ret;
 }
 
 void removeFromRoad(Road *road, unsigned routeId) {
-  Routes *routes = road->routes;
-  Routes *prev = NULL;
-  bool found = false;
-  while (!found && routes) {
-    if (routes->routeId == routeId) {
-      found = true;
-      if (prev) {
-        prev->next = routes->next;
-      } else {
-        road->routes = routes->next;
-      }
-      free(routes);
-    }
-    prev = routes;
-    routes = routes->next;
-  }
+  dropRoute(&road->routes, routeId);
 }
 
 bool removeRoute(Map *map, unsigned routeId) {
   if (routeId > 999 || !routeId || !map->routes[routeId]) {
     return false;
   }
-  Edges *edges = map->routes[routeId]->edges;
-  while (edges) {
-    removeFromRoad(edges->road, routeId);
-    edges = edges->next;
+  Route *route = map->routes[routeId];
+  for (size_t i = 0; i < route->size; i++) {
+    removeFromRoad(routeStep(route, i)->road, routeId);
   }
   freeRoute(map->routes[routeId]);
   map->routes[routeId] = NULL;
@@ -9,29 +9,58 @@
 #ifndef __MAP_H__
 #define __MAP_H__
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include "heap.h"
+#include "hierarchy.h"
 
-#define N 60013  /**<Lucky number for division of cities for hashing*/
+#define MIN_SLOTS 16  /**<Initial number of slots in the city index*/
+#define CITY_BLOCK 1024  /**<Number of cities in one block of storage*/
+#define NAME_CHUNK 65536  /**<Smallest chunk of the name arena*/
+#define NO_CITY UINT32_MAX  /**<Id marking an empty slot of the index*/
+#define HASH_KEY 0xa0761d6478bd642fULL /**<Multiplier mixing name hashes*/
 #define R 1000  /**<Maximum possible route id plus one*/
+#define INLINE_ROUTES 4  /**<Routes kept in a road before using a bitset*/
+#define ROUTE_WORDS ((R + 63) / 64)  /**<Words of a bitset of routes*/
+#define MAX_WORKERS 16  /**<Maximum number of threads repairing routes*/
+#define WORKER_KEEP 65536  /**<Cities whose search state a helper keeps*/
 
 typedef struct Road Road;          /**<Structure for list of roads*/
 typedef struct City City;          /**<Structure for city*/
 typedef struct HeapNode HeapNode;  /**<Structure for heap node*/
 typedef struct Route Route;        /**<Structure for route*/
+typedef struct Step Step;          /**<Structure for road of a route*/
 typedef struct Edges Edges;        /**<Structure for list of edges*/
-typedef struct Routes Routes;      /**<Structure for list of routes*/
+typedef struct RouteSet RouteSet;  /**<Structure for set of routes*/
+typedef struct Goal Goal;          /**<Structure for destination of search*/
+typedef struct Slot Slot;          /**<Structure for slot of city index*/
+typedef struct NameChunk NameChunk; /**<Structure for chunk of names*/
+typedef struct RoadSlot RoadSlot;  /**<Structure for slot of road index*/
+typedef struct Mask Mask;          /**<Structure for blocked cities*/
+typedef struct Repair Repair;      /**<Structure for repairs of routes*/
+typedef struct Worker Worker;      /**<Structure for thread of repairs*/
 
 /**
  * @brief Structure for city
  */
 struct City {
-  char *name;           /**<Name of the city*/
-  City *next;           /**<Next city in the list*/
-  bool allowed;         /**<Allowance of the city*/
-  HeapNode *heapNode;   /**<Address of the city in heap*/
+  char *name;           /**<Name of the city, kept in the name arena*/
+  uint32_t id;          /**<Dense number of the city on the map*/
   Edges *edges;         /**<Adjacent cities list*/
+  uint64_t *landmarks;  /**<Distances from every landmark*/
+  uint32_t rank;        /**<Position of the city in the hierarchy*/
+};
+/**
+ * @brief Structure for set of routes passing a road
+ */
+struct RouteSet {
+  uint16_t size;        /**<Number of routes in the set*/
+  uint16_t ids[INLINE_ROUTES]; /**<Sorted ids while there is no bitset*/
+  uint32_t at[INLINE_ROUTES];  /**<Positions of the road in those routes*/
+  uint64_t *bits;       /**<Bitset over route ids or NULL*/
+  uint32_t *spots;      /**<Positions indexed by route id with the bitset*/
 };
 /**
  * @brief Structure for road between cities
@@ -41,17 +70,10 @@ struct Road {
   City *to;             /**<Ending of the road*/
   unsigned length;      /**<Length of the road*/
   int year;             /**<Length of the road*/
-  Routes *routes;       /**<Routes from which road passes*/
+  RouteSet routes;      /**<Routes from which road passes*/
   Road *next;           /**<Next road in the list*/
   Road *prev;           /**<Previous road in the list*/
 };
-/**
- * @brief Structure for list of routes
- */
-struct Routes {
-  unsigned routeId;     /**<id of the route*/
-  Routes *next;         /**<Next route in the list*/
-};
 /**
  * @brief Structure for edges
  */
@@ -68,15 +90,115 @@ struct Route {
   City *end;            /**<Ending city of the route*/
   uint64_t totalCost;   /**<Total length of the route*/
   int year;             /**<Oldest year of the route*/
-  Edges *edges;         /**<List of edges in the route*/
+  Step *steps;          /**<Deque of roads of the route from the start*/
+  uint32_t head;        /**<Roads pushed at the front, base of positions*/
+  size_t first;         /**<Position of the first road in the deque*/
+  size_t size;          /**<Number of roads in the route*/
+  size_t capacity;      /**<Allocated length of the deque*/
+};
+/**
+ * @brief Structure for road of a route
+ */
+struct Step {
+  Road *road;           /**<The road*/
+  bool forward;         /**<Does the route go from road->from to road->to*/
+};
+/**
+ * @brief Structure for slot of the open addressing index of cities
+ */
+struct Slot {
+  uint32_t hash;        /**<Low half of the hash of the name*/
+  uint32_t id;          /**<Id of the city or NO_CITY if the slot is empty*/
+};
+/**
+ * @brief Structure for slot of the index of roads by their ends
+ */
+struct RoadSlot {
+  uint64_t key;         /**<Ids of the ends, smaller one in high half*/
+  Road *road;           /**<The road or NULL if the slot is empty*/
+};
+/**
+ * @brief Structure for chunk of the arena keeping names of cities
+ */
+struct NameChunk {
+  NameChunk *next;      /**<Chunk filled before this one*/
+  size_t used;          /**<Number of bytes taken*/
+  size_t size;          /**<Number of bytes in the chunk*/
+  char data[];          /**<Names separated by zero bytes*/
+};
+/**
+ * @brief Structure for set of cities a search may not enter
+ */
+struct Mask {
+  uint32_t *stamps;     /**<Generation which blocked the city, by id*/
+  uint32_t capacity;    /**<Number of allocated stamps*/
+  uint32_t epoch;       /**<Current generation, older stamps are void*/
+};
+/**
+ * @brief Structure for repairs of the routes passing a removed road
+ */
+struct Repair {
+  struct Map *map;      /**<Map from which the road is removed*/
+  Road *road;           /**<The removed road*/
+  City *source;         /**<City from which detours start*/
+  City *target;         /**<City at which detours end*/
+  unsigned *ids;        /**<Routes passing the road in increasing order*/
+  Route **detours;      /**<Detours found for the routes or NULL*/
+  size_t count;         /**<Number of the routes*/
+  atomic_size_t next;   /**<First route not taken by any thread*/
+  atomic_bool failed;   /**<Has some route no unique detour*/
+};
+/**
+ * @brief Structure for thread searching for detours
+ */
+struct Worker {
+  Scratch scratch;      /**<Nodes of the searches of the thread*/
+  Mask mask;            /**<Cities blocked for the searches of the thread*/
+  struct Map *map;      /**<Map whose repairs the thread takes part in*/
+  unsigned index;       /**<Position of the worker in the map*/
+  uint64_t round;       /**<Last repair seen by the thread*/
+  pthread_t thread;     /**<The thread, once started*/
 };
 /**
  * @brief Structure for whole of the map
  */
 struct Map{
-  City *cities[N];      /**<Array of cities on the map*/
+  Slot *slots;          /**<Index of cities with linear probing*/
+  size_t slotCount;     /**<Number of slots, a power of two*/
+  City **blocks;        /**<Blocks of CITY_BLOCK cities in order of ids*/
+  uint32_t cityCount;   /**<Number of cities on the map*/
+  NameChunk *names;     /**<Arena of names, the newest chunk first*/
+  RoadSlot *roadSlots;  /**<Index of roads with linear probing*/
+  size_t roadSlotCount; /**<Number of road slots, a power of two*/
+  size_t roadCount;     /**<Number of roads on the map*/
+  uint64_t seed;        /**<Random seed of name hashes*/
+  Mask mask;            /**<Cities blocked for the current operation*/
+  Scratch scratch;      /**<Nodes reused by the searches on the map*/
+  unsigned workerCount; /**<Threads searching for detours or loading roads*/
+  Worker workers[MAX_WORKERS]; /**<State of threads other than the caller*/
+  unsigned startedWorkers; /**<Threads of the pool started so far*/
+  pthread_mutex_t poolLock; /**<Lock of the repair handed to the pool*/
+  pthread_cond_t poolWake; /**<Signals a new repair or deleting the map*/
+  pthread_cond_t poolDone; /**<Signals the last helper finishing a repair*/
+  Repair *repair;       /**<Repair handed to the pool*/
+  uint64_t repairRound; /**<Number of repairs handed to the pool*/
+  unsigned helpers;     /**<Threads of the pool taking part in the repair*/
+  unsigned busy;        /**<Helpers still searching for detours*/
+  bool closing;         /**<Are the threads of the pool told to exit*/
   Route *routes[R];     /**<Array of routes on the map*/
   Road *roads;          /**<List of roads on the map*/
+  HeapEngine engine;    /**<Queue used by searches on the map*/
+  unsigned landmarkCount; /**<Number of prepared landmarks*/
+  bool landmarksStale;  /**<Was a road added or removed since preparing*/
+  Hierarchy *hierarchy; /**<Contraction hierarchy or NULL*/
+  bool hierarchyStale;  /**<Was a road added or removed since building*/
+};
+/**
+ * @brief Structure for destination of a guided search
+ */
+struct Goal {
+  struct Map *map;      /**<Map on which the search runs*/
+  City *target;         /**<Destination of the search*/
 };
 
 /**
@@ -218,4 +340,73 @@ char const* getRouteDescription(Map *map, unsigned routeId);
  */
 bool removeRoute(Map *map, unsigned routeId);
 
+/** @brief Selects the priority queue used by route searches.
+ * Both queues give identical routes, they differ only in speed. The radix
+ * heap is the default, since road lengths are integers and the searched
+ * distances never decrease. The program map chooses the queue with
+ * --heap=dary or --heap=radix.
+ * @param[in,out] map    – wskaźnik na strukturę przechowującą mapę dróg;
+ * @param[in] engine     – rodzaj kolejki.
+ */
+void setHeapEngine(Map *map, HeapEngine engine);
+
+/** @brief Prepares landmarks speeding up route searches.
+ * Chooses up to @p count landmark cities, each one as far as possible from
+ * the ones chosen before, and stores the distances from them to every city.
+ * Searches use them as lower bounds on the distance left to the destination,
+ * which does not change the chosen routes. Adding or removing a road makes
+ * the landmarks stale, searches ignore them until they are prepared again.
+ * Repairing a road does not change distances and keeps them valid. The
+ * program map prepares @p count of them with --landmarks=count right after
+ * loading its road list.
+ * @param[in,out] map    – wskaźnik na strukturę przechowującą mapę dróg;
+ * @param[in] count      – liczba punktów orientacyjnych, 0 je wyłącza.
+ */
+void prepareLandmarks(Map *map, unsigned count);
+
+/** @brief Builds a contraction hierarchy speeding up route searches.
+ * Contracts the cities one by one, adding shortcuts which keep the distances
+ * between the remaining ones. A search then takes the exact distance left to
+ * the destination from the hierarchy and explores little more than the
+ * shortest paths themselves, so routes, years and ambiguity stay as without
+ * it. Adding or removing a road makes the hierarchy stale, searches ignore it
+ * until it is built again. Repairing a road keeps it valid. The program map
+ * builds it with --hierarchy right after loading its road list.
+ * @param[in,out] map    – wskaźnik na strukturę przechowującą mapę dróg.
+ */
+void prepareHierarchy(Map *map);
+
+/** @brief Sets the number of threads searching for detours in removeRoad.
+ * Detours of the routes passing the removed road are independent searches, so
+ * up to @p count of them run at once. The routes are changed only after all
+ * detours are found, in the order of their numbers, so the result does not
+ * depend on the number of threads. The default is the number of processors.
+ * The threads are started by the first removeRoad needing them and wait for
+ * the following ones until the map is deleted. Every thread searching at once
+ * needs about 44 bytes for each city its search reaches. After a repair a
+ * helper keeps this memory only if the map has at most WORKER_KEEP cities.
+ * Searches guided by the contraction hierarchy share its state and run one
+ * by one.
+ * loadRoads splits its work among the same number of threads.
+ * @param[in,out] map    – wskaźnik na strukturę przechowującą mapę dróg;
+ * @param[in] count      – liczba wątków, od 1 do MAX_WORKERS.
+ */
+void setRepairWorkers(Map *map, unsigned count);
+
+/** @brief Adds the roads of a list at once, as addRoad would one by one.
+ * Every line of the list has the form "city1;city2;length;builtYear" and
+ * stands for a call of addRoad with these arguments, empty lines are skipped.
+ * The lines are parsed and the repeated names and roads found by as many
+ * threads as set by setRepairWorkers, then the cities and roads are added in
+ * the order of the lines, so the map is the same as after the calls.
+ * The list is only read, names are copied once their cities are added.
+ * @param[in,out] map    – wskaźnik na strukturę przechowującą mapę dróg;
+ * @param[in] list       – wskaźnik na tekst listy odcinków dróg;
+ * @param[in] size       – długość tekstu listy;
+ * @param[out] rejected  – wskaźnik, pod którym zapisywana jest tablica numerów
+ *                         odrzuconych linii, lub NULL.
+ * @return Liczba linii, dla których addRoad zwróciłoby @p false.
+ */
+size_t loadRoads(Map *map, const char *list, size_t size, size_t **rejected);
+
 #endif /* __MAP_H__ */
@@ -0,0 +1,44 @@
+#ifndef DROGI_MAP_INTERNAL_H
+#define DROGI_MAP_INTERNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "map.h"
+
+Route *startRoute(City *start);
+void reserveSteps(Route *route, size_t front, size_t back);
+void pushBack(Route *route, Road *road, bool forward);
+uint64_t mixHash(uint64_t a, uint64_t b);
+uint64_t hashSpan(Map *map, const char *name, size_t n);
+uint64_t hashName(Map *map, const char *name);
+City *findSpan(Map *map, const char *city, size_t n, uint64_t hash);
+City *findCity(Map *map, const char *city, uint64_t hash);
+void growSlots(Map *map);
+City *insertSpan(Map *map, const char *city, size_t n, uint64_t hash);
+City *insertCity(Map *map, const char *city, uint64_t hash);
+City *obtainCity(Map *map, const char *city);
+void dropCities(Map *map, uint32_t count);
+uint64_t roadKey(City *city1, City *city2);
+Road *isConnected(Map *map, City *city1, City *city2);
+void growRoadSlots(Map *map);
+Road *makeRoad(City *city1, City *city2, unsigned length, int builtYear,
+               Edges **edges);
+void linkRoad(Map *map, Road *road, Edges **edges);
+Road *connectCities(Map *map, City *city1, City *city2,
+                    unsigned length, int builtYear);
+bool addValidRoad(Map *map, const char *city1, const char *city2,
+                  unsigned length, int builtYear);
+bool repairValidRoad(Map *map, const char *city1,
+                     const char *city2, int repairYear);
+City *toCity(Road *road, City *from);
+void clearMask(Mask *mask);
+void blockCity(Mask *mask, City *city);
+bool blockedCity(Mask *mask, City *city);
+void giveId(Route *route, unsigned routeId);
+bool newValidRoute(Map *map, unsigned routeId,
+                   const char *city1, const char *city2);
+bool extendValidRoute(Map *map, unsigned routeId, const char *city);
+bool removeValidRoad(Map *map, const char *city1, const char *city2);
+
+#endif
@@ -5,17 +5,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "map.h"
+#include "map_internal.h"
+#include "scan.h"
 
-bool badName(const char *city);
-City *cityExists(Map *map, const char *city);
-Road *isConnected(City *city1, City *city2);
-City *addCity(Map *map, const char *city);
-void connectCities(Map *map, City *city1, City *city2,
-                   unsigned length, int builtYear);
-void giveId(Route *route, unsigned routeId);
-bool existId(Road *road, unsigned id);
+#define INPUT_CHUNK (1 << 20)  /**<Bytes of input read or given back at once*/
+#define OUTPUT_LIMIT (1 << 16) /**<Bytes of output buffered before writing*/
+#define LANDMARK_LIMIT 64      /**<Limit of landmarks on the command line*/
 
+/**
+ * @brief Structure for road of a route definition checked but not applied
+ */
+struct Hop {
+  City *city;       /**<City at the end of the road*/
+  Road *road;       /**<Existing road or NULL if it is to be built*/
+  unsigned length;  /**<Length of the road*/
+  int year;         /**<Year of building or repair of the road*/
+};
+/**
+ * @brief Structure for standard input read in large blocks
+ */
+struct Input {
+  int fd;           /**<Descriptor of the file read*/
+  char *data;       /**<Buffer or mapping of the input*/
+  size_t size;      /**<Number of bytes of input in data*/
+  size_t capacity;  /**<Allocated length of the buffer*/
+  size_t position;  /**<Beginning of the next line in data*/
+  size_t scanned;   /**<Bytes from position known to have no newline*/
+  size_t released;  /**<Bytes of the mapping already given back*/
+  bool mapped;      /**<Is the input a mapped regular file*/
+  bool finished;    /**<Was the end of the input read*/
+  char *line;       /**<Copy of the current line of the mapping*/
+  size_t lineCapacity; /**<Allocated length of the line copy*/
+};
+/**
+ * @brief Structure for output collected before writing to a stream
+ */
+struct Output {
+  FILE *stream;     /**<Stream which receives the output*/
+  char *data;       /**<The output collected so far*/
+  size_t size;      /**<Number of bytes collected*/
+};
 /**
  * @brief Structure to combine command's components
  */
@@ -24,539 +58,547 @@ struct Command {
   size_t length;  /**<Length of the command*/
   int lineNumber; /**<Line number in input which command is given*/
   Map *map;       /**<Structure map which is used in all of the commands*/
+  Field *fields;         /**<Fields of the line split in place*/
+  size_t fieldCount;     /**<Number of fields of the line*/
+  size_t fieldCapacity;  /**<Allocated length of the fields array*/
+  struct Output *output; /**<Buffered standard output*/
+  struct Output *errors; /**<Buffered standard error*/
+  struct Hop *hops;      /**<Roads of the route definition being staged*/
+  size_t hopCount;       /**<Number of staged roads*/
+  size_t hopCapacity;    /**<Allocated length of the hops array*/
 };
+
 /**
- * @brief Structure to store visited cities for proper route
+ * @brief Structure for options given on the command line
  */
-struct visitedCities {
-  City *city;                     /**<Address of the city*/
-  struct visitedCities *next;     /**<Next city in the list*/
+struct Options {
+  const char *list;    /**<File with a road list loaded first or NULL*/
+  HeapEngine engine;   /**<Queue used by route searches*/
+  unsigned landmarks;  /**<Landmarks prepared after loading the list*/
+  bool hierarchy;      /**<Is a hierarchy built after loading the list*/
 };
 
+typedef struct Hop Hop;
+typedef struct Input Input;
+typedef struct Output Output;
 typedef struct Command Command;
-typedef struct visitedCities visitedCities;
+typedef struct Options Options;
 
-bool endOfComponent(char c) {
-  return c == ';' || c == '\0' || c == '\n';
+void openOutput(Output *output, FILE *stream) {
+  output->stream = stream;
+  output->data = malloc(OUTPUT_LIMIT);
+  output->size = 0;
 }
 
-char *nextComponent(size_t *to, size_t from, char *line, size_t length) {
-  char *new = NULL;
-  size_t total = 0;
-  size_t i;
-  for (i = from; i < length && !endOfComponent(line[i]); i++) {
-    total++;
-  }
-  new = malloc(total + 1);
-  for (i = from; i < length && !endOfComponent(line[i]); i++) {
-    new[i - from] = line[i];
-  }
-  *to = i;
-  new[total] = '\0';
-  return new;
+void flushOutput(Output *output) {
+  fwrite(output->data, 1, output->size, output->stream);
+  fflush(output->stream);
+  output->size = 0;
 }
 
-bool isInt(const char *s) {
-  size_t i = (s[0] == '-');
-  size_t n = strlen(s);
-  size_t nonZero = n;
-  for (; i < n; i++) {
-    if (!(s[i] >= '0' && s[i] <= '9')) {
-      return false;
+void closeOutput(Output *output) {
+  flushOutput(output);
+  free(output->data);
+}
+
+void writeText(Output *output, const char *text, size_t length) {
+  if (output->size + length > OUTPUT_LIMIT) {
+    flushOutput(output);
+    if (length > OUTPUT_LIMIT) {
+      fwrite(text, 1, length, output->stream);
+      return;
     }
-    if (s[i] != '0' && nonZero == n) {
-      nonZero = i;
+  }
+  memcpy(output->data + output->size, text, length);
+  output->size += length;
+}
+
+void writeNumber(Output *output, long long number) {
+  char digits[24];
+  int i = sizeof(digits);
+  unsigned long long value = number < 0 ? -(unsigned long long)number
+                                        : (unsigned long long)number;
+  do {
+    digits[--i] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  if (number < 0) {
+    digits[--i] = '-';
+  }
+  writeText(output, digits + i, sizeof(digits) - i);
+}
+
+void openInput(Input *input, int fd) {
+  struct stat status;
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  input->fd = fd;
+  input->position = input->scanned = input->released = 0;
+  input->finished = false;
+  input->line = NULL;
+  input->lineCapacity = 0;
+  input->mapped = false;
+  if (!fstat(fd, &status) && S_ISREG(status.st_mode) &&
+      offset >= 0 && status.st_size > offset) {
+    input->data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (input->data != MAP_FAILED) {
+      input->mapped = input->finished = true;
+      input->size = status.st_size;
+      input->position = offset;
+      input->capacity = 0;
+#ifdef MADV_SEQUENTIAL
+      madvise(input->data, input->size, MADV_SEQUENTIAL);
+#endif
+      return;
     }
   }
-  if (nonZero == n) {
-    return false;
+  input->capacity = INPUT_CHUNK + 1;
+  input->data = malloc(input->capacity);
+  input->size = 0;
+}
+
+void closeInput(Input *input) {
+  if (input->mapped) {
+    munmap(input->data, input->size);
+  } else {
+    free(input->data);
   }
-  const char *maxi = "2147483647\0";
-  n -= nonZero;
-  if (n > strlen(maxi)) {
-    return false;
-  } else if (n < strlen(maxi)) {
-    return true;
+  free(input->line);
+}
+
+void releaseInput(Input *input) {
+  size_t page = sysconf(_SC_PAGESIZE), upto;
+  if (input->position - input->released < INPUT_CHUNK) {
+    return;
+  }
+  upto = input->position / page * page;
+#ifdef MADV_DONTNEED
+  madvise(input->data + input->released, upto - input->released,
+          MADV_DONTNEED);
+#endif
+  input->released = upto;
+}
+
+void readInput(Command *command, Input *input) {
+  ssize_t count;
+  if (input->position) {
+    memmove(input->data, input->data + input->position,
+            input->size - input->position);
+    input->size -= input->position;
+    input->position = 0;
+  }
+  if (input->capacity - input->size < INPUT_CHUNK + 1) {
+    input->capacity = 2 * input->capacity;
+    input->data = realloc(input->data, input->capacity);
+  }
+  flushOutput(command->output);
+  flushOutput(command->errors);
+  count = read(input->fd, input->data + input->size,
+               input->capacity - input->size - 1);
+  if (count <= 0) {
+    input->finished = true;
   } else {
-    if (s[0] == '-') {
-      maxi = "2147483648\0";
-    }
-    if (strcmp(&s[nonZero], maxi) > 0) {
-      return false;
-    } else {
-      return true;
-    }
+    input->size += count;
   }
 }
 
-bool isUInt(const char *s) {
-  size_t n = strlen(s);
-  size_t nonZero = n;
-  for (size_t i = 0; i < n; i++) {
-    if (!(s[i] >= '0' && s[i] <= '9')) {
-      return false;
+void copyLine(Command *command, Input *input) {
+  if (command->length + 1 > input->lineCapacity) {
+    input->lineCapacity = 2 * (command->length + 1);
+    input->line = realloc(input->line, input->lineCapacity);
+  }
+  memcpy(input->line, command->line, command->length);
+  input->line[command->length] = '\0';
+  command->line = input->line;
+  releaseInput(input);
+}
+
+bool nextLine(Command *command, Input *input) {
+  char *newline;
+  command->line = input->data + input->position;
+  while (true) {
+    newline = memchr(input->data + input->position + input->scanned, '\n',
+                     input->size - input->position - input->scanned);
+    if (newline) {
+      command->length = newline - command->line + 1;
+      break;
     }
-    if (s[i] != '0' && nonZero == n) {
-      nonZero = i;
+    input->scanned = input->size - input->position;
+    if (input->finished) {
+      if (!input->scanned) {
+        return false;
+      }
+      command->length = input->scanned;
+      break;
     }
+    readInput(command, input);
+    command->line = input->data;
   }
-  if (nonZero == n) {
-    return true;
+  input->position += command->length;
+  input->scanned = 0;
+  if (input->mapped) {
+    copyLine(command, input);
+  } else if (!newline) {
+    command->line[command->length++] = '\0';
   }
-  const char *maxi = "4294967295\0";
-  n -= nonZero;
-  if (n > strlen(maxi)) {
-    return false;
-  } else if (n < strlen(maxi)) {
-    return true;
-  } else {
-    if (strcmp(&s[nonZero], maxi) > 0) {
-      return false;
-    } else {
-      return true;
+  return true;
+}
+
+void splitLine(Command *command) {
+  size_t i = 0, from;
+  char end = ';';
+  bool control;
+  Field *field;
+  command->fieldCount = 0;
+  while (end == ';') {
+    if (command->fieldCount == command->fieldCapacity) {
+      command->fieldCapacity = command->fieldCapacity ?
+                               2 * command->fieldCapacity : 16;
+      command->fields = realloc(command->fields,
+                                command->fieldCapacity * sizeof(Field));
+    }
+    from = i;
+    i += scanField(command->line + i, command->length - i, &control);
+    end = i < command->length ? command->line[i] : '\0';
+    field = &command->fields[command->fieldCount++];
+    field->text = command->line + from;
+    field->length = i - from;
+    field->end = end;
+    field->name = field->length && !control;
+    if (i < command->length) {
+      command->line[i++] = '\0';
     }
   }
 }
 
-void errorOnLine(int lineNumber) {
-  fprintf(stderr, "ERROR %d\n", lineNumber);
+void errorOnLine(Command command) {
+  writeText(command.errors, "ERROR ", 6);
+  writeNumber(command.errors, command.lineNumber);
+  writeText(command.errors, "\n", 1);
+}
+
+void errorOnList(Command command, size_t line) {
+  writeText(command.errors, "LIST ERROR ", 11);
+  writeNumber(command.errors, line);
+  writeText(command.errors, "\n", 1);
 }
 
 void checkAddRoad(Command command) {
-  size_t lastPosition = strlen("addRoad;\0");
-  char *city1 = nextComponent(&lastPosition, lastPosition, command.line,
-                              command.length);
-  if (!strlen(city1) || command.line[lastPosition] != ';') {
-    free(city1);
-    errorOnLine(command.lineNumber);
-    return;
-  }
-  char *city2 = nextComponent(&lastPosition, ++lastPosition, command.line,
-                              command.length);
-  if (!strlen(city2) || command.line[lastPosition] != ';') {
-    free(city1);
-    free(city2);
-    errorOnLine(command.lineNumber);
-    return;
-  }
-  char *length = nextComponent(&lastPosition, ++lastPosition, command.line,
-                               command.length);
-  if (!strlen(length) || command.line[lastPosition] != ';' || !isUInt(length)) {
-    free(city1);
-    free(city2);
-    free(length);
-    errorOnLine(command.lineNumber);
-    return;
-  }
-  char *builtYear = nextComponent(&lastPosition, ++lastPosition, command.line,
-                                  command.length);
-  if (!strlen(builtYear) || command.line[lastPosition] != '\n' ||
-      !isInt(builtYear)) {
-    free(city1);
-    free(city2);
-    free(length);
-    free(builtYear);
-    errorOnLine(command.lineNumber);
+  Field *fields = command.fields;
+  unsigned length;
+  int year;
+  if (command.fieldCount != 5 || !fields[1].name || !fields[2].name ||
+      !parseUInt(&fields[3], &length) || !parseInt(&fields[4], &year) ||
+      fields[4].end != '\n') {
+    errorOnLine(command);
     return;
   }
-  unsigned roadLength = strtol(length, NULL, 10);
-  int roadYear = strtol(builtYear, NULL, 10);
-  if (!addRoad(command.map, city1, city2, roadLength, roadYear)) {
-    errorOnLine(command.lineNumber);
+  if (!addValidRoad(command.map, fields[1].text, fields[2].text,
+                    length, year)) {
+    errorOnLine(command);
   }
-  free(city1);
-  free(city2);
-  free(length);
-  free(builtYear);
 }
 
 void checkRepairRoad(Command command) {
-  size_t lastPosition = strlen("repairRoad;\0");
-  char *city1 = nextComponent(&lastPosition, lastPosition, command.line,
-                              command.length);
-  if (!strlen(city1) || command.line[lastPosition] != ';') {
-    free(city1);
-    errorOnLine(command.lineNumber);
-    return;
-  }
-  char *city2 = nextComponent(&lastPosition, ++lastPosition, command.line,
-                              command.length);
-  if (!strlen(city2) || command.line[lastPosition] != ';') {
-    free(city1);
-    free(city2);
-    errorOnLine(command.lineNumber);
-    return;
-  }
-  char *repairYear = nextComponent(&lastPosition, ++lastPosition, command.line,
-                                   command.length);
-  if (!strlen(repairYear) || command.line[lastPosition] != '\n' || !isInt
-      (repairYear)) {
-    free(city1);
-    free(city2);
-    free(repairYear);
-    errorOnLine(command.lineNumber);
+  Field *fields = command.fields;
+  int year;
+  if (command.fieldCount != 4 || !fields[1].name || !fields[2].name ||
+      !parseInt(&fields[3], &year) || fields[3].end != '\n') {
+    errorOnLine(command);
     return;
   }
-  int roadYear = strtol(repairYear, NULL, 10);
-  if (!repairRoad(command.map, city1, city2, roadYear)) {
-    errorOnLine(command.lineNumber);
+  if (!repairValidRoad(command.map, fields[1].text, fields[2].text, year)) {
+    errorOnLine(command);
   }
-  free(city1);
-  free(city2);
-  free(repairYear);
 }
 
 void checkDescription(Command command) {
-  size_t lastPosition = strlen("getRouteDescription;\0");
-  char *routeId = nextComponent(&lastPosition, lastPosition, command.line,
-                                command.length);
-  if (!strlen(routeId) || command.line[lastPosition] != '\n' || !isUInt
-      (routeId)) {
-    free(routeId);
-    errorOnLine(command.lineNumber);
+  Field *fields = command.fields;
+  unsigned id;
+  if (command.fieldCount != 2 || !parseUInt(&fields[1], &id) ||
+      fields[1].end != '\n') {
+    errorOnLine(command);
     return;
   }
-  unsigned id = strtol(routeId, NULL, 10);
   const char *result = getRouteDescription(command.map, id);
   if (result) {
-    puts(result);
+    writeText(command.output, result, strlen(result));
+    writeText(command.output, "\n", 1);
   }
-  free(routeId);
   free((void *)result);
 }
 
-void addVisited(visitedCities **cities, City *city) {
-  visitedCities *use = malloc(sizeof(visitedCities));
-  use->city = city;
-  use->next = *cities;
-  (*cities) = use;
-}
-
-void freeVisited(visitedCities *cities) {
-  visitedCities *use;
-  while (cities) {
-    use = cities->next;
-    cities->city->allowed = true;
-    free(cities);
-    cities = use;
-  }
-}
-
-bool checkRouteFirst(Command command) {
-  size_t lastPosition = 0;
-  char *routeId = nextComponent(&lastPosition, 0, command.line, command.length);
-  unsigned id = strtol(routeId, NULL, 10);
-  if (id > 999 || command.map->routes[id]) {
-    free(routeId);
-    return false;
-  }
-  free(routeId);
-  char *lastCity = nextComponent(&lastPosition, ++lastPosition, command.line,
-                                 command.length);
-  if (command.line[lastPosition] != ';' || badName(lastCity)) {
-    free(lastCity);
-    return false;
-  }
-  bool stop = false;
-  char *use;
+City *stageRoute(Command *command, unsigned id) {
+  Field *fields = command->fields;
+  Map *map = command->map;
   unsigned length;
   int year;
-  City *left = cityExists(command.map, lastCity), *right;
-  if (!left) {
-    left = addCity(command.map, lastCity);
+  if (id > 999 || map->routes[id]) {
+    return NULL;
+  }
+  if (fields[1].end != ';' || !fields[1].name) {
+    return NULL;
   }
-  left->allowed = false;
-  free(lastCity);
+  City *first = obtainCity(map, fields[1].text), *left = first, *right;
+  uint64_t hash;
+  Mask *mask = &map->mask;
+  clearMask(mask);
+  blockCity(mask, left);
   Road *road;
-  visitedCities *cities = NULL;
-  addVisited(&cities, left);
-  while (!stop) {
-    if (lastPosition + 1 > command.length - 1) {
-      freeVisited(cities);
-      return false;
+  Hop *hop;
+  command->hopCount = 0;
+  for (size_t i = 2; fields[i - 1].end != '\n'; i += 3) {
+    if (fields[i].end != ';' || !parseUInt(&fields[i], &length) || !length) {
+      return NULL;
     }
-    use = nextComponent(&lastPosition, ++lastPosition, command.line,
-                        command.length);
-    if (!strlen(use) || command.line[lastPosition] != ';' || !isUInt(use) ||
-        !(unsigned)strtol(use, NULL, 10)) {
-      freeVisited(cities);
-      free(use);
-      return false;
+    if (fields[i + 1].end != ';' || !parseInt(&fields[i + 1], &year)) {
+      return NULL;
     }
-    length = strtol(use, NULL, 10);
-    free(use);
-    use = nextComponent(&lastPosition, ++lastPosition, command.line,
-                        command.length);
-    if (!strlen(use) || command.line[lastPosition] != ';' || !isInt(use)) {
-      freeVisited(cities);
-      free(use);
-      return false;
-    }
-    year = strtol(use, NULL, 10);
-    free(use);
-    use = nextComponent(&lastPosition, ++lastPosition, command.line,
-                        command.length);
-    if (badName(use)) {
-      freeVisited(cities);
-      free(use);
-      return false;
+    if (!fields[i + 2].name) {
+      return NULL;
     }
-    if (command.line[lastPosition] == '\n') {
-      stop = true;
-    } else if (command.line[lastPosition] != ';') {
-      freeVisited(cities);
-      free(use);
-      return false;
+    if (fields[i + 2].end != '\n' && fields[i + 2].end != ';') {
+      return NULL;
     }
-    right = cityExists(command.map, use);
+    hash = hashName(map, fields[i + 2].text);
+    right = findCity(map, fields[i + 2].text, hash);
     if (!right) {
-      right = addCity(command.map, use);
-      right->allowed = false;
-      addVisited(&cities, right);
-      free(use);
+      right = insertCity(map, fields[i + 2].text, hash);
+      road = NULL;
+    } else if (blockedCity(mask, right)) {
+      return NULL;
     } else {
-      free(use);
-      if (!right->allowed) {
-        freeVisited(cities);
-        return false;
-      } else {
-        right->allowed = false;
-        addVisited(&cities, right);
-      }
+      road = isConnected(map, left, right);
     }
-    road = isConnected(left, right);
+    blockCity(mask, right);
     if (road && (road->length != length || road->year > year)) {
-      freeVisited(cities);
-      return false;
+      return NULL;
+    }
+    if (command->hopCount == command->hopCapacity) {
+      command->hopCapacity = command->hopCapacity ?
+                             2 * command->hopCapacity : 16;
+      command->hops = realloc(command->hops,
+                              command->hopCapacity * sizeof(Hop));
     }
+    hop = &command->hops[command->hopCount++];
+    hop->city = right;
+    hop->road = road;
+    hop->length = length;
+    hop->year = year;
     left = right;
   }
-  freeVisited(cities);
-  return true;
+  return first;
 }
 
-void makeNewRoute(Command command) {
-  size_t lastPosition = 0;
-  char *routeId = nextComponent(&lastPosition, 0, command.line, command.length);
-  char *lastCity = nextComponent(&lastPosition, ++lastPosition, command.line,
-                                 command.length);
-  bool stop = false;
-  char *use;
-  unsigned length;
-  int year;
-  City *left = cityExists(command.map, lastCity), *right = NULL;
-  free(lastCity);
-  Route *newRoute = malloc(sizeof(Route));
-  Edges *useEdges, *starting = NULL;
-  Road *useRoad;
-  newRoute->start = left;
-  newRoute->edges = NULL;
-  while (!stop) {
-    use = nextComponent(&lastPosition, ++lastPosition, command.line,
-                        command.length);
-    length = strtol(use, NULL, 10);
-    free(use);
-    use = nextComponent(&lastPosition, ++lastPosition, command.line,
-                        command.length);
-    year = strtol(use, NULL, 10);
-    free(use);
-    use = nextComponent(&lastPosition, ++lastPosition, command.line,
-                        command.length);
-    if (command.line[lastPosition] == '\n') {
-      stop = true;
-    }
-    right = cityExists(command.map, use);
-    if (stop) {
-      newRoute->end = right;
-    }
-    free(use);
-    useRoad = isConnected(left, right);
-    if (!useRoad) {
-      connectCities(command.map, left, right, length, year);
-    } else {
-      useRoad->year = year;
-    }
-    useEdges = malloc(sizeof(Edges));
-    useEdges->road = isConnected(left, right);
-    useEdges->next = NULL;
-    useEdges->prev = newRoute->edges;
-    if (newRoute->edges) {
-      newRoute->edges->next = useEdges;
+void commitRoute(Command *command, unsigned id, City *first) {
+  Map *map = command->map;
+  Route *route = startRoute(first);
+  City *left = first;
+  Hop *hop;
+  reserveSteps(route, 0, command->hopCount);
+  for (size_t i = 0; i < command->hopCount; i++) {
+    hop = &command->hops[i];
+    if (!hop->road) {
+      hop->road = connectCities(map, left, hop->city, hop->length, hop->year);
     } else {
-      starting = useEdges;
+      hop->road->year = hop->year;
     }
-    newRoute->edges = useEdges;
-    left = right;
+    pushBack(route, hop->road, hop->road->from == left);
+    left = hop->city;
   }
-  unsigned id = strtol(routeId, NULL, 0);
-  newRoute->edges = starting;
-  Map *map = command.map;
-  map->routes[id] = newRoute;
-  giveId(newRoute, id);
-  free(routeId);
+  route->end = left;
+  map->routes[id] = route;
+  giveId(route, id);
 }
 
-void checkNewRoute(Command command) {
-  if (!checkRouteFirst(command)) {
-    errorOnLine(command.lineNumber);
+void checkNewRoute(Command *command, unsigned id) {
+  uint32_t cities = command->map->cityCount;
+  City *first = stageRoute(command, id);
+  if (!first) {
+    dropCities(command->map, cities);
+    errorOnLine(*command);
     return;
   }
-  makeNewRoute(command);
+  commitRoute(command, id, first);
 }
 
 void checkAddRoute(Command command) {
-  size_t lastPosition = strlen("newRoute;\0");
-  char *routeId = nextComponent(&lastPosition, lastPosition, command.line,
-                                command.length);
-  if (!strlen(routeId) || command.line[lastPosition] != ';' || !isUInt
-    (routeId)) {
-    free(routeId);
-    errorOnLine(command.lineNumber);
-    return;
-  }
-  char *city1 = nextComponent(&lastPosition, ++lastPosition, command.line,
-                              command.length);
-  if (!strlen(city1) || command.line[lastPosition] != ';') {
-    free(routeId);
-    free(city1);
-    errorOnLine(command.lineNumber);
-    return;
-  }
-  char *city2 = nextComponent(&lastPosition, ++lastPosition, command.line,
-                              command.length);
-  if (!strlen(city2) || command.line[lastPosition] != '\n') {
-    free(routeId);
-    free(city1);
-    free(city2);
-    errorOnLine(command.lineNumber);
+  Field *fields = command.fields;
+  unsigned id;
+  if (command.fieldCount != 4 || !parseUInt(&fields[1], &id) ||
+      !fields[2].name || !fields[3].name || fields[3].end != '\n') {
+    errorOnLine(command);
     return;
   }
-  unsigned id = strtol(routeId, NULL, 10);
-  if (!newRoute(command.map, id, city1, city2)) {
-    errorOnLine(command.lineNumber);
+  if (!newValidRoute(command.map, id, fields[2].text, fields[3].text)) {
+    errorOnLine(command);
   }
-  free(routeId);
-  free(city1);
-  free(city2);
 }
 
 void checkExtendRoute(Command command) {
-  size_t lastPosition = strlen("extendRoute;\0");
-  char *routeId = nextComponent(&lastPosition, lastPosition, command.line,
-                                command.length);
-  if (!strlen(routeId) || command.line[lastPosition] != ';' || !isUInt
-    (routeId)) {
-    free(routeId);
-    errorOnLine(command.lineNumber);
-    return;
-  }
-  char *city = nextComponent(&lastPosition, ++lastPosition, command.line,
-                             command.length);
-  if (!strlen(city) || command.line[lastPosition] != '\n') {
-    free(routeId);
-    free(city);
-    errorOnLine(command.lineNumber);
+  Field *fields = command.fields;
+  unsigned id;
+  if (command.fieldCount != 3 || !parseUInt(&fields[1], &id) ||
+      !fields[2].name || fields[2].end != '\n') {
+    errorOnLine(command);
     return;
   }
-  unsigned id = strtol(routeId, NULL, 10);
-  if (!extendRoute(command.map, id, city)) {
-    errorOnLine(command.lineNumber);
+  if (!extendValidRoute(command.map, id, fields[2].text)) {
+    errorOnLine(command);
   }
-  free(routeId);
-  free(city);
 }
 
 void checkRemoveRoad(Command command) {
-  size_t lastPosition = strlen("removeRoad;\0");
-  char *city1 = nextComponent(&lastPosition, lastPosition, command.line,
-                              command.length);
-  if (!strlen(city1) || command.line[lastPosition] != ';') {
-    free(city1);
-    errorOnLine(command.lineNumber);
+  Field *fields = command.fields;
+  if (command.fieldCount != 3 || !fields[1].name || !fields[2].name ||
+      fields[2].end != '\n') {
+    errorOnLine(command);
     return;
   }
-  char *city2 = nextComponent(&lastPosition, ++lastPosition, command.line,
-                              command.length);
-  if (!strlen(city2) || command.line[lastPosition] != '\n') {
-    free(city1);
-    free(city2);
-    errorOnLine(command.lineNumber);
-    return;
+  if (!removeValidRoad(command.map, fields[1].text, fields[2].text)) {
+    errorOnLine(command);
   }
-  if (!removeRoad(command.map, city1, city2)) {
-    errorOnLine(command.lineNumber);
-  }
-  free(city1);
-  free(city2);
 }
 
 void checkRemoveRoute(Command command) {
-  size_t lastPosition = strlen("removeRoute;\0");
-  char *routeId = nextComponent(&lastPosition, lastPosition, command.line,
-                                command.length);
-  if (!strlen(routeId) || command.line[lastPosition] != '\n' || !isUInt
-    (routeId)) {
-    free(routeId);
-    errorOnLine(command.lineNumber);
+  Field *fields = command.fields;
+  unsigned id;
+  if (command.fieldCount != 2 || !parseUInt(&fields[1], &id) ||
+      fields[1].end != '\n') {
+    errorOnLine(command);
     return;
   }
-  unsigned id = strtol(routeId, NULL, 10);
   if (!removeRoute(command.map, id)) {
-    errorOnLine(command.lineNumber);
+    errorOnLine(command);
   }
-  free(routeId);
 }
 
-void switchCommand(Command command) {
-  if (command.line[0] == '#' || command.line[0] == '\n') {
+void switchCommand(Command *command) {
+  if (command->line[0] == '#' || command->line[0] == '\n') {
     return;
   }
-  size_t start = 0;
-  char *beginWith = nextComponent(&start, 0, command.line, command.length);
-  if (command.line[start] != ';') {
-    fprintf(stderr, "ERROR %d\n", command.lineNumber);
-  } else if (!strcmp(beginWith, "addRoad\0")) {
-    checkAddRoad(command);
-  } else if (!strcmp(beginWith, "repairRoad\0")) {
-    checkRepairRoad(command);
-  } else if (!strcmp(beginWith, "getRouteDescription\0")) {
-    checkDescription(command);
-  } else if (!strcmp(beginWith, "newRoute\0")) {
-    checkAddRoute(command);
-  } else if (!strcmp(beginWith, "extendRoute\0")) {
-    checkExtendRoute(command);
-  } else if (!strcmp(beginWith, "removeRoad\0")) {
-    checkRemoveRoad(command);
-  } else if (!strcmp(beginWith, "removeRoute\0")) {
-    checkRemoveRoute(command);
+  splitLine(command);
+  const char *name = command->fields[0].text;
+  unsigned id;
+  if (command->fields[0].end != ';') {
+    errorOnLine(*command);
+  } else if (!strcmp(name, "addRoad")) {
+    checkAddRoad(*command);
+  } else if (!strcmp(name, "repairRoad")) {
+    checkRepairRoad(*command);
+  } else if (!strcmp(name, "getRouteDescription")) {
+    checkDescription(*command);
+  } else if (!strcmp(name, "newRoute")) {
+    checkAddRoute(*command);
+  } else if (!strcmp(name, "extendRoute")) {
+    checkExtendRoute(*command);
+  } else if (!strcmp(name, "removeRoad")) {
+    checkRemoveRoad(*command);
+  } else if (!strcmp(name, "removeRoute")) {
+    checkRemoveRoute(*command);
   } else {
-    if (isUInt(beginWith) && (unsigned)strtol(beginWith, NULL, 10)) {
-      checkNewRoute(command);
+    if (parseUInt(&command->fields[0], &id) && id) {
+      checkNewRoute(command, id);
+    } else {
+      errorOnLine(*command);
+    }
+  }
+}
+
+bool loadList(Command *command, const char *path) {
+  Input input;
+  size_t *rejected, count;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  openInput(&input, fd);
+  while (!input.finished) {
+    readInput(command, &input);
+  }
+  count = loadRoads(command->map, input.data + input.position,
+                    input.size - input.position, &rejected);
+  for (size_t i = 0; i < count; i++) {
+    errorOnList(*command, rejected[i]);
+  }
+  free(rejected);
+  closeInput(&input);
+  close(fd);
+  return true;
+}
+
+bool parseOptions(Options *options, int argc, char *argv[]) {
+  Field field;
+  options->list = NULL;
+  options->engine = RADIX_HEAP;
+  options->landmarks = 0;
+  options->hierarchy = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--heap=dary")) {
+      options->engine = DARY_HEAP;
+    } else if (!strcmp(argv[i], "--heap=radix")) {
+      options->engine = RADIX_HEAP;
+    } else if (!strncmp(argv[i], "--landmarks=", 12)) {
+      field.text = argv[i] + 12;
+      field.length = strlen(field.text);
+      if (!parseUInt(&field, &options->landmarks) ||
+          options->landmarks > LANDMARK_LIMIT) {
+        return false;
+      }
+    } else if (!strcmp(argv[i], "--hierarchy")) {
+      options->hierarchy = true;
+    } else if (argv[i][0] == '-' || options->list) {
+      return false;
     } else {
-      fprintf(stderr, "ERROR %d\n", command.lineNumber);
+      options->list = argv[i];
     }
   }
-  free(beginWith);
+  return true;
 }
 
-void start() {
+int start(Options *options) {
   Command command;
+  Input input;
+  Output output, errors;
   command.line = NULL;
   command.length = 0;
   command.lineNumber = 0;
   command.map = newMap();
-  while (getline(&command.line, &command.length, stdin) != -1) {
-    command.lineNumber++;
-    switchCommand(command);
-    free(command.line);
-    command.line = NULL;
-    command.length = 0;
+  setHeapEngine(command.map, options->engine);
+  command.fields = NULL;
+  command.fieldCount = command.fieldCapacity = 0;
+  command.hops = NULL;
+  command.hopCount = command.hopCapacity = 0;
+  openOutput(&output, stdout);
+  openOutput(&errors, stderr);
+  command.output = &output;
+  command.errors = &errors;
+  bool loaded = !options->list || loadList(&command, options->list);
+  if (loaded) {
+    if (options->landmarks) {
+      prepareLandmarks(command.map, options->landmarks);
+    }
+    if (options->hierarchy) {
+      prepareHierarchy(command.map);
+    }
+    openInput(&input, STDIN_FILENO);
+    while (nextLine(&command, &input)) {
+      command.lineNumber++;
+      switchCommand(&command);
+    }
+    closeInput(&input);
   }
+  closeOutput(&output);
+  closeOutput(&errors);
   deleteMap(command.map);
-  free(command.line);
+  free(command.fields);
+  free(command.hops);
+  return loaded ? 0 : 1;
 }
 
-int main(void) {
-  start();
-  return 0;
-}
\ No newline at end of file
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parseOptions(&options, argc, argv)) {
+    return 1;
+  }
+  return start(&options);
+}
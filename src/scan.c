@@ -0,0 +1,141 @@
+#include "scan.h"
+#include <stdatomic.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+bool controlChar(char c) {
+  return c >= 0 && c <= 31;
+}
+
+size_t scanScalar(const char *text, size_t limit, bool *control) {
+  size_t i = 0;
+  *control = false;
+  while (i < limit && text[i] != ';' && text[i] != '\n' && text[i] != '\0') {
+    *control |= controlChar(text[i]);
+    i++;
+  }
+  return i;
+}
+
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+size_t scanSse2(const char *text, size_t limit, bool *control) {
+  const __m128i semicolon = _mm_set1_epi8(';'), newline = _mm_set1_epi8('\n');
+  const __m128i space = _mm_set1_epi8(' '), minus = _mm_set1_epi8(-1);
+  const __m128i zero = _mm_setzero_si128();
+  bool found = false;
+  size_t i = 0;
+  for (; i + SSE2_BLOCK <= limit; i += SSE2_BLOCK) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(text + i));
+    __m128i ends = _mm_or_si128(_mm_cmpeq_epi8(block, semicolon),
+                                _mm_or_si128(_mm_cmpeq_epi8(block, newline),
+                                             _mm_cmpeq_epi8(block, zero)));
+    __m128i small = _mm_and_si128(_mm_cmpgt_epi8(space, block),
+                                  _mm_cmpgt_epi8(block, minus));
+    unsigned endBits = _mm_movemask_epi8(ends);
+    unsigned smallBits = _mm_movemask_epi8(small);
+    if (endBits) {
+      unsigned at = __builtin_ctz(endBits);
+      *control = found || (smallBits & ((1u << at) - 1));
+      return i + at;
+    }
+    found |= smallBits != 0;
+  }
+  i += scanScalar(text + i, limit - i, control);
+  *control |= found;
+  return i;
+}
+
+__attribute__((target("avx2")))
+size_t scanAvx2(const char *text, size_t limit, bool *control) {
+  const __m256i semicolon = _mm256_set1_epi8(';');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i space = _mm256_set1_epi8(' '), minus = _mm256_set1_epi8(-1);
+  const __m256i zero = _mm256_setzero_si256();
+  bool found = false;
+  size_t i = 0;
+  for (; i + AVX2_BLOCK <= limit; i += AVX2_BLOCK) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(text + i));
+    __m256i ends = _mm256_or_si256(
+        _mm256_cmpeq_epi8(block, semicolon),
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, newline),
+                        _mm256_cmpeq_epi8(block, zero)));
+    __m256i small = _mm256_and_si256(_mm256_cmpgt_epi8(space, block),
+                                     _mm256_cmpgt_epi8(block, minus));
+    unsigned endBits = _mm256_movemask_epi8(ends);
+    unsigned smallBits = _mm256_movemask_epi8(small);
+    if (endBits) {
+      unsigned at = __builtin_ctz(endBits);
+      *control = found || (smallBits & ((1u << at) - 1));
+      return i + at;
+    }
+    found |= smallBits != 0;
+  }
+  i += scanSse2(text + i, limit - i, control);
+  *control |= found;
+  return i;
+}
+#endif
+
+Scanner chooseScanner(void) {
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return scanAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return scanSse2;
+  }
+#endif
+  return scanScalar;
+}
+
+size_t scanField(const char *text, size_t limit, bool *control) {
+  static _Atomic(Scanner) chosen = NULL;
+  Scanner scanner = atomic_load_explicit(&chosen, memory_order_relaxed);
+  if (!scanner) {
+    scanner = chooseScanner();
+    atomic_store_explicit(&chosen, scanner, memory_order_relaxed);
+  }
+  return scanner(text, limit, control);
+}
+
+bool parseUInt(Field *field, unsigned *value) {
+  uint64_t result = 0;
+  if (!field->length) {
+    return false;
+  }
+  for (size_t i = 0; i < field->length; i++) {
+    if (field->text[i] < '0' || field->text[i] > '9') {
+      return false;
+    }
+    result = result * 10 + (field->text[i] - '0');
+    if (result > UINT32_MAX) {
+      return false;
+    }
+  }
+  *value = result;
+  return true;
+}
+
+bool parseInt(Field *field, int *value) {
+  bool negative = field->length && field->text[0] == '-';
+  uint64_t limit = negative ? (uint64_t)INT32_MAX + 1 : INT32_MAX;
+  uint64_t result = 0;
+  for (size_t i = negative; i < field->length; i++) {
+    if (field->text[i] < '0' || field->text[i] > '9') {
+      return false;
+    }
+    result = result * 10 + (field->text[i] - '0');
+    if (result > limit) {
+      return false;
+    }
+  }
+  if (!result) {
+    return false;
+  }
+  *value = negative ? (int)-(int64_t)result : (int)result;
+  return true;
+}
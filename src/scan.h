@@ -0,0 +1,34 @@
+#ifndef DROGI_SCAN_H
+#define DROGI_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SSE2_BLOCK 16            /**<Bytes compared at once with SSE2*/
+#define AVX2_BLOCK 32            /**<Bytes compared at once with AVX2*/
+
+typedef struct Field Field;
+
+/**
+ * @brief Structure for field of a command kept in the line itself
+ */
+struct Field {
+  const char *text; /**<Start of the field in the line*/
+  size_t length;  /**<Length of the field*/
+  char end;       /**<Character which ended the field*/
+  bool name;      /**<Is the field a correct name of a city*/
+};
+/**
+ * @brief Kernel finding the end of a field of a command
+ * Returns index of the first semicolon, newline or null character among
+ * @p limit characters of @p text, or @p limit if there is none, and tells
+ * whether any character before it is a control one.
+ */
+typedef size_t (*Scanner)(const char *text, size_t limit, bool *control);
+
+size_t scanField(const char *text, size_t limit, bool *control);
+bool parseUInt(Field *field, unsigned *value);
+bool parseInt(Field *field, int *value);
+
+#endif